@@ -9,16 +9,613 @@
 #include <string>
 #include <algorithm>
 #include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <cstdarg>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GAME_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define NOINLINE __attribute__((noinline))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define NOINLINE
+#endif
+
+// The frame profiler is built in unless NO_PROFILER is defined, in which case
+// the PROFILE_* macros expand to nothing.
+#ifndef NO_PROFILER
+#define GAME_PROFILER 1
+#endif
+
+// Heap allocation counting is built in unless NO_ALLOC_TRACKING is defined.
+#ifndef NO_ALLOC_TRACKING
+#define GAME_ALLOC_TRACKING 1
+#endif
 
 using namespace std;
 
 const int SCREEN_WIDTH = 1200;
 const int SCREEN_HEIGHT = 800;
 
+// Gameplay advances in fixed steps, independent of how fast frames are drawn.
+const int SIM_HZ = 120;
+const float SIM_DT = 1.0f / SIM_HZ;
+const int MAX_CATCHUP_STEPS = 8;
+const int TARGET_FPS = 60;
+
+const Uint32 WALL_COOLDOWN_MS = 10000;
+const Uint32 SHIELD_LIFETIME_MS = 2000;
+
 enum GameState {
-    MENU, PLAYING, GAME_OVER, HOW_TO_PLAY, SETTINGS, HIGHSCORE
+    MENU, PLAYING, GAME_OVER, HOW_TO_PLAY, SETTINGS, HIGHSCORE, GAME_STATE_COUNT
+};
+
+// Outside PLAYING nothing moves on its own, so the loop sleeps until an
+// event arrives or this long has passed.
+const int IDLE_WAIT_MS = 1000;
+
+// Frame profiler. Scoped timers push (phase, start, end) events into a ring
+// buffer owned by the calling thread; once a frame the main thread drains all
+// rings, sums time per phase, keeps a few seconds of history for the F3
+// overlay and optionally streams per-frame CSV and Chrome trace JSON.
+enum ProfilePhase {
+    PHASE_EVENTS, PHASE_SIM, PHASE_PLAYER, PHASE_SPAWN, PHASE_BULLETS, PHASE_COLLISION,
+    PHASE_SHIELDS, PHASE_RENDER, PHASE_TEXT, PHASE_PRESENT, PHASE_COUNT
+};
+
+const char* PHASE_NAMES[PHASE_COUNT] = {
+    "events", "sim", "player", "spawn", "bullets", "collision", "shields", "render", "text", "present"
+};
+
+// Heap allocations, counted per ProfilePhase of the allocating thread. The
+// phase is whatever ProfileScope is open on that thread; allocations outside
+// any scope (or with NO_PROFILER) land in ALLOC_OTHER. Both operator new and
+// SDL's allocator are counted.
+const int ALLOC_OTHER = PHASE_COUNT;
+const char* ALLOC_OTHER_NAME = "other";
+thread_local int allocPhase = ALLOC_OTHER;
+
+struct AllocCounts {
+    Uint64 count[PHASE_COUNT + 1];
+    Uint64 bytes[PHASE_COUNT + 1];
+
+    Uint64 totalCount() const {
+        Uint64 n = 0;
+        for (Uint64 c : count) n += c;
+        return n;
+    }
+
+    Uint64 totalBytes() const {
+        Uint64 n = 0;
+        for (Uint64 b : bytes) n += b;
+        return n;
+    }
+};
+
+struct AllocStats {
+    atomic<Uint64> count[PHASE_COUNT + 1];
+    atomic<Uint64> bytes[PHASE_COUNT + 1];
+
+    void note(size_t size) {
+        count[allocPhase].fetch_add(1, memory_order_relaxed);
+        bytes[allocPhase].fetch_add(size, memory_order_relaxed);
+    }
+
+    AllocCounts read() const {
+        AllocCounts c;
+        for (int i = 0; i <= PHASE_COUNT; i++) {
+            c.count[i] = count[i].load(memory_order_relaxed);
+            c.bytes[i] = bytes[i].load(memory_order_relaxed);
+        }
+        return c;
+    }
+
+    // Allocations since an earlier read().
+    AllocCounts since(const AllocCounts& before) const {
+        AllocCounts c = read();
+        for (int i = 0; i <= PHASE_COUNT; i++) {
+            c.count[i] -= before.count[i];
+            c.bytes[i] -= before.bytes[i];
+        }
+        return c;
+    }
+};
+
+AllocStats allocStats;
+AllocCounts lastFrameAllocs = {}; // heap allocations during the previous frame, all threads
+
+#ifdef GAME_ALLOC_TRACKING
+// Out of line, or GCC inlines them into callers and then warns that the
+// free() does not match the new.
+NOINLINE void* operator new(size_t size) {
+    allocStats.note(size);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+NOINLINE void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+NOINLINE void operator delete(void* p) noexcept {
+    free(p);
+}
+
+NOINLINE void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+SDL_malloc_func sdlMalloc;
+SDL_calloc_func sdlCalloc;
+SDL_realloc_func sdlRealloc;
+SDL_free_func sdlFree;
+
+void* SDLCALL countedMalloc(size_t size) {
+    allocStats.note(size);
+    return sdlMalloc(size);
+}
+
+void* SDLCALL countedCalloc(size_t n, size_t size) {
+    allocStats.note(n * size);
+    return sdlCalloc(n, size);
+}
+
+void* SDLCALL countedRealloc(void* p, size_t size) {
+    allocStats.note(size);
+    return sdlRealloc(p, size);
+}
+#endif
+
+// Routes SDL's allocations through allocStats. Must run before SDL_Init.
+void trackSdlAllocations() {
+#ifdef GAME_ALLOC_TRACKING
+    SDL_GetMemoryFunctions(&sdlMalloc, &sdlCalloc, &sdlRealloc, &sdlFree);
+    SDL_SetMemoryFunctions(countedMalloc, countedCalloc, countedRealloc, sdlFree);
+#endif
+}
+
+const size_t FRAME_ARENA_BYTES = 64 * 1024;
+
+// Bump allocator for data that only lives until the end of the frame; the
+// main loop resets it at the top of every frame. format() is snprintf into
+// the arena, for numbers and labels drawn every frame. When the arena is
+// full it hands out nothing rather than falling back to the heap.
+struct FrameArena {
+    char* base;
+    size_t capacity;
+    size_t used = 0;
+
+    explicit FrameArena(size_t bytes) : base((char*)malloc(bytes)), capacity(base ? bytes : 0) {}
+
+    void reset() {
+        used = 0;
+    }
+
+    void* alloc(size_t size, size_t align = 16) {
+        size_t start = (used + align - 1) & ~(align - 1);
+        if (start + size > capacity) return nullptr;
+        used = start + size;
+        return base + start;
+    }
+
+    const char* format(const char* fmt, ...) {
+        if (used >= capacity) return "";
+        char* out = base + used;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(out, capacity - used, fmt, args);
+        va_end(args);
+        if (n < 0) return "";
+        used += min((size_t)n + 1, capacity - used);
+        return out;
+    }
+};
+
+FrameArena frameArena(FRAME_ARENA_BYTES);
+
+#ifdef GAME_PROFILER
+struct ProfileEvent {
+    Uint64 start, end;
+    int phase;
+};
+
+struct ProfileRing {
+    static const Uint32 CAPACITY = 1 << 14;
+    ProfileEvent events[CAPACITY];
+    atomic<Uint32> head{0}, tail{0};
+    int threadIndex = 0;
+
+    // Called only by the owning thread; drops the event when full.
+    void push(const ProfileEvent& e) {
+        Uint32 h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) >= CAPACITY) return;
+        events[h % CAPACITY] = e;
+        head.store(h + 1, memory_order_release);
+    }
+};
+
+const int PROFILE_HISTORY = 240;
+
+struct Profiler {
+    atomic<bool> enabled{false};
+    mutex registryLock;
+    vector<ProfileRing*> rings;
+
+    // history[f][PHASE_COUNT] holds the whole frame time.
+    float history[PROFILE_HISTORY][PHASE_COUNT + 1];
+    int frames = 0;
+    float current[PHASE_COUNT];
+    Uint64 frameStart = 0;
+    bool overlay = false;
+    FILE* csv = nullptr;
+    FILE* trace = nullptr;
+    bool traceEmpty = true;
+
+    ProfileRing* ring();
+
+    void openCsv(const char* path) {
+        csv = fopen(path, "w");
+        if (!csv) return;
+        fprintf(csv, "frame,frame_ms");
+        for (int p = 0; p < PHASE_COUNT; p++) fprintf(csv, ",%s_ms", PHASE_NAMES[p]);
+        fprintf(csv, "\n");
+    }
+
+    void openTrace(const char* path) {
+        trace = fopen(path, "w");
+        if (trace) fprintf(trace, "{\"traceEvents\":[\n");
+    }
+
+    void beginFrame() {
+        frameStart = SDL_GetPerformanceCounter();
+        for (int p = 0; p < PHASE_COUNT; p++) current[p] = 0;
+    }
+
+    void endFrame() {
+        Uint64 frameEnd = SDL_GetPerformanceCounter();
+        double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+        {
+            lock_guard<mutex> guard(registryLock);
+            for (ProfileRing* r : rings) {
+                Uint32 h = r->head.load(memory_order_acquire);
+                Uint32 t = r->tail.load(memory_order_relaxed);
+                for (; t != h; t++) {
+                    const ProfileEvent& e = r->events[t % ProfileRing::CAPACITY];
+                    current[e.phase] += (float)((e.end - e.start) * toMs);
+                    if (trace) {
+                        fprintf(trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                                traceEmpty ? "" : ",\n", PHASE_NAMES[e.phase], r->threadIndex,
+                                e.start * toMs * 1000.0, (e.end - e.start) * toMs * 1000.0);
+                        traceEmpty = false;
+                    }
+                }
+                r->tail.store(t, memory_order_release);
+            }
+        }
+
+        float* row = history[frames % PROFILE_HISTORY];
+        for (int p = 0; p < PHASE_COUNT; p++) row[p] = current[p];
+        row[PHASE_COUNT] = (float)((frameEnd - frameStart) * toMs);
+        if (csv) {
+            fprintf(csv, "%d,%.4f", frames, row[PHASE_COUNT]);
+            for (int p = 0; p < PHASE_COUNT; p++) fprintf(csv, ",%.4f", row[p]);
+            fprintf(csv, "\n");
+        }
+        frames++;
+    }
+
+    // min / avg / p99 of one column over the recorded history.
+    void stats(int column, float& lo, float& avg, float& p99) const {
+        int n = min(frames, PROFILE_HISTORY);
+        float values[PROFILE_HISTORY];
+        float sum = 0;
+        lo = n ? history[0][column] : 0;
+        for (int i = 0; i < n; i++) {
+            values[i] = history[i][column];
+            lo = min(lo, values[i]);
+            sum += values[i];
+        }
+        avg = n ? sum / n : 0;
+        if (n == 0) {
+            p99 = 0;
+            return;
+        }
+        int k = (int)ceil(0.99 * n) - 1;
+        nth_element(values, values + k, values + n);
+        p99 = values[k];
+    }
+
+    void close() {
+        if (csv) fclose(csv);
+        if (trace) {
+            fprintf(trace, "\n]}\n");
+            fclose(trace);
+        }
+        csv = trace = nullptr;
+    }
+};
+
+Profiler profiler;
+thread_local ProfileRing* threadProfileRing = nullptr;
+
+ProfileRing* Profiler::ring() {
+    if (!threadProfileRing) {
+        threadProfileRing = new ProfileRing();
+        lock_guard<mutex> guard(registryLock);
+        threadProfileRing->threadIndex = (int)rings.size();
+        rings.push_back(threadProfileRing);
+    }
+    return threadProfileRing;
+}
+
+struct ProfileScope {
+    int phase;
+    int outerPhase; // allocPhase to restore
+    Uint64 start;
+
+    explicit ProfileScope(int p) : phase(p), outerPhase(allocPhase), start(profiler.enabled.load(memory_order_relaxed) ? SDL_GetPerformanceCounter() : 0) {
+        allocPhase = p;
+    }
+
+    void stop() {
+        if (start) profiler.ring()->push(ProfileEvent{start, SDL_GetPerformanceCounter(), phase});
+        start = 0;
+        allocPhase = outerPhase;
+    }
+
+    ~ProfileScope() {
+        stop();
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(phase)
+#define PROFILE_BEGIN(name, phase) ProfileScope name(phase)
+#define PROFILE_END(name) name.stop()
+#else
+#define PROFILE_SCOPE(phase) do {} while (0)
+#define PROFILE_BEGIN(name, phase) do {} while (0)
+#define PROFILE_END(name) do {} while (0)
+#endif
+
+// Draw calls and texture switches submitted during the current frame.
+struct RenderStats {
+    int drawCalls = 0;
+    int textureBinds = 0;
+    SDL_Texture* bound = nullptr;
+
+    void beginFrame() {
+        drawCalls = 0;
+        textureBinds = 0;
+        bound = nullptr;
+    }
+
+    void draw(SDL_Texture* tex) {
+        drawCalls++;
+        if (tex && tex != bound) {
+            textureBinds++;
+            bound = tex;
+        }
+    }
+};
+
+RenderStats renderStats;
+RenderStats lastFrameStats;
+
+// Text is drawn from one glyph atlas texture per font. Strings drawn at the
+// same spot on consecutive frames keep their laid-out quads, so a static label
+// costs a single draw and a changing number only re-lays the characters after
+// the first one that differs.
+const int FIRST_GLYPH = 32;
+const int LAST_GLYPH = 126;
+const int ATLAS_WIDTH = 1024;
+
+struct GlyphInfo {
+    SDL_Rect src;
+    int advance;
+};
+
+struct FontAtlas {
+    SDL_Texture* tex = nullptr;
+    int width = 0, height = 0;
+    GlyphInfo glyphs[LAST_GLYPH - FIRST_GLYPH + 1];
+
+    const GlyphInfo& glyph(char c) const {
+        if (c < FIRST_GLYPH || c > LAST_GLYPH) c = '?';
+        return glyphs[c - FIRST_GLYPH];
+    }
+};
+
+struct TextKey {
+    TTF_Font* font;
+    int x, y;
+
+    bool operator<(const TextKey& o) const {
+        if (font != o.font) return font < o.font;
+        if (x != o.x) return x < o.x;
+        return y < o.y;
+    }
+};
+
+const int TEXT_RESERVE_CHARS = 64; // room reserved in each new layout
+
+struct TextLayout {
+    string text;
+    SDL_Color color;
+    vector<SDL_Vertex> verts; // four per character
+    vector<float> pen;        // pen x before each character, plus the end
+    Uint32 lastUsed = 0;
 };
 
+struct TextCache {
+    map<TTF_Font*, FontAtlas> atlases;
+    map<TextKey, TextLayout> layouts;
+    vector<int> indices;
+    Uint32 frame = 0;
+
+    FontAtlas& build(SDL_Renderer* renderer, TTF_Font* font) {
+        FontAtlas& atlas = atlases[font];
+        if (atlas.tex) return atlas;
+
+        SDL_Color white = {255, 255, 255, 255};
+        SDL_Surface* surfaces[LAST_GLYPH - FIRST_GLYPH + 1];
+        int x = 0, y = 0, rowHeight = 0;
+        for (int c = FIRST_GLYPH; c <= LAST_GLYPH; c++) {
+            GlyphInfo& g = atlas.glyphs[c - FIRST_GLYPH];
+            int minX, maxX, minY, maxY;
+            g.advance = 0;
+            if (TTF_GlyphMetrics(font, (Uint16)c, &minX, &maxX, &minY, &maxY, &g.advance) != 0) g.advance = 0;
+
+            SDL_Surface* surface = TTF_RenderGlyph_Blended(font, (Uint16)c, white);
+            surfaces[c - FIRST_GLYPH] = surface;
+            int w = surface ? surface->w : 0;
+            int h = surface ? surface->h : 0;
+            if (x + w + 1 > ATLAS_WIDTH) {
+                x = 0;
+                y += rowHeight + 1;
+                rowHeight = 0;
+            }
+            g.src = {x, y, w, h};
+            x += w + 1;
+            rowHeight = max(rowHeight, h);
+        }
+
+        atlas.width = ATLAS_WIDTH;
+        atlas.height = max(y + rowHeight, 1);
+        SDL_Surface* sheet = SDL_CreateRGBSurfaceWithFormat(0, atlas.width, atlas.height, 32, SDL_PIXELFORMAT_RGBA32);
+        for (int i = 0; i <= LAST_GLYPH - FIRST_GLYPH; i++) {
+            if (!surfaces[i]) continue;
+            SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(surfaces[i], NULL, sheet, &atlas.glyphs[i].src);
+            SDL_FreeSurface(surfaces[i]);
+        }
+        atlas.tex = SDL_CreateTextureFromSurface(renderer, sheet);
+        SDL_SetTextureBlendMode(atlas.tex, SDL_BLENDMODE_BLEND);
+        SDL_FreeSurface(sheet);
+        return atlas;
+    }
+
+    int width(SDL_Renderer* renderer, TTF_Font* font, const string& text) {
+        FontAtlas& atlas = build(renderer, font);
+        int w = 0;
+        for (char c : text) w += atlas.glyph(c).advance;
+        return w;
+    }
+
+    // Lays out text[from..] continuing from the pen position already stored.
+    void layout(const FontAtlas& atlas, TextLayout& l, size_t from, int y) {
+        l.verts.resize(from * 4);
+        l.pen.resize(from + 1);
+        float penX = l.pen[from];
+        SDL_Color color = {l.color.r, l.color.g, l.color.b, 255};
+        for (size_t i = from; i < l.text.size(); i++) {
+            const GlyphInfo& g = atlas.glyph(l.text[i]);
+            float x0 = penX, y0 = (float)y;
+            float x1 = x0 + g.src.w, y1 = y0 + g.src.h;
+            float u0 = (float)g.src.x / atlas.width, v0 = (float)g.src.y / atlas.height;
+            float u1 = (float)(g.src.x + g.src.w) / atlas.width, v1 = (float)(g.src.y + g.src.h) / atlas.height;
+            l.verts.push_back({{x0, y0}, color, {u0, v0}});
+            l.verts.push_back({{x1, y0}, color, {u1, v0}});
+            l.verts.push_back({{x1, y1}, color, {u1, v1}});
+            l.verts.push_back({{x0, y1}, color, {u0, v1}});
+            penX += g.advance;
+            l.pen.push_back(penX);
+        }
+    }
+
+    // Text that changes every frame (timers, counters) reuses its layout's
+    // buffers, so once they have grown to fit, drawing does not allocate.
+    void draw(SDL_Renderer* renderer, TTF_Font* font, const char* text, int x, int y, SDL_Color color) {
+        if (!text[0]) return;
+        PROFILE_SCOPE(PHASE_TEXT);
+        FontAtlas& atlas = build(renderer, font);
+        TextLayout& l = layouts[TextKey{font, x, y}];
+        l.lastUsed = frame;
+
+        if (l.pen.empty()) {
+            l.text.reserve(TEXT_RESERVE_CHARS);
+            l.verts.reserve(TEXT_RESERVE_CHARS * 4);
+            l.pen.reserve(TEXT_RESERVE_CHARS + 1);
+            l.pen.push_back((float)x);
+            l.text.clear();
+        }
+        if (l.color.r != color.r || l.color.g != color.g || l.color.b != color.b) {
+            l.color = color;
+            for (auto& v : l.verts) v.color = {color.r, color.g, color.b, 255};
+        }
+        if (l.text.compare(text) != 0) {
+            size_t same = 0;
+            while (same < l.text.size() && text[same] && l.text[same] == text[same]) same++;
+            l.text.assign(text);
+            layout(atlas, l, same, y);
+        }
+
+        size_t quads = l.text.size();
+        while (indices.size() < quads * 6) {
+            int base = (int)(indices.size() / 6) * 4;
+            int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+        SDL_RenderGeometry(renderer, atlas.tex, l.verts.data(), (int)l.verts.size(), indices.data(), (int)(quads * 6));
+        renderStats.draw(atlas.tex);
+    }
+
+    // Called once per frame; forgets layouts that have not been drawn lately.
+    void beginFrame() {
+        frame++;
+        if (frame % 256 != 0) return;
+        for (auto it = layouts.begin(); it != layouts.end();) {
+            if (frame - it->second.lastUsed > 240) it = layouts.erase(it);
+            else ++it;
+        }
+    }
+
+    void clear() {
+        for (auto& entry : atlases) SDL_DestroyTexture(entry.second.tex);
+        atlases.clear();
+        layouts.clear();
+    }
+};
+
+TextCache textCache;
+
+void renderText(SDL_Renderer* renderer, TTF_Font* font, const char* text, int x, int y, SDL_Color color = {255, 255, 255}) {
+    textCache.draw(renderer, font, text, x, y, color);
+}
+
+void renderText(SDL_Renderer* renderer, TTF_Font* font, const string& text, int x, int y, SDL_Color color = {255, 255, 255}) {
+    textCache.draw(renderer, font, text.c_str(), x, y, color);
+}
+
 struct Button {
     SDL_Rect rect;
     string text;
@@ -32,383 +629,5683 @@ struct Button {
     void render(SDL_Renderer* renderer, TTF_Font* font) {
         SDL_SetRenderDrawColor(renderer, 100, 100, 100, 200);
         SDL_RenderFillRect(renderer, &rect);
+        renderStats.draw(nullptr);
 
         SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
         SDL_RenderDrawRect(renderer, &rect);
+        renderStats.draw(nullptr);
 
         SDL_Color white = {255, 255, 255};
-        SDL_Surface* surface = TTF_RenderText_Solid(font, text.c_str(), white);
-        SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-
-        SDL_Rect textRect = {
-            rect.x + (rect.w - surface->w) / 2,
-            rect.y + (rect.h - surface->h) / 2,
-            surface->w,
-            surface->h
-        };
+        int textW = textCache.width(renderer, font, text);
+        int textH = TTF_FontHeight(font);
+        renderText(renderer, font, text, rect.x + (rect.w - textW) / 2, rect.y + (rect.h - textH) / 2, white);
+    }
+};
+
+// Bullet, wall and player images are packed into one texture at load time so
+// every gameplay sprite in a frame goes out in a single SDL_RenderGeometry
+// call. Sources are scaled down to at most SPRITE_MAX_SIDE on load; they are
+// drawn far smaller than that anyway.
+enum SpriteId {
+    SPRITE_BULLET = 0, // six bullet looks, SPRITE_BULLET + texIndex
+    SPRITE_WALL = 6,
+    SPRITE_PLAYER_LEFT,
+    SPRITE_PLAYER_RIGHT,
+    SPRITE_COUNT
+};
+
+const int SPRITE_MAX_SIDE = 256;
+const int SPRITE_ATLAS_WIDTH = 1024;
+
+struct SpriteAtlas {
+    SDL_Texture* tex = nullptr;
+    SDL_FRect uv[SPRITE_COUNT];
+
+    // Takes ownership of the surfaces; missing ones just draw nothing.
+    void build(SDL_Renderer* renderer, SDL_Surface* images[SPRITE_COUNT]) {
+        SDL_Rect placed[SPRITE_COUNT];
+        int x = 0, y = 0, rowHeight = 0;
+        for (int i = 0; i < SPRITE_COUNT; i++) {
+            int w = 0, h = 0;
+            if (images[i]) {
+                float scale = min(1.0f, (float)SPRITE_MAX_SIDE / max(images[i]->w, images[i]->h));
+                w = max(1, (int)(images[i]->w * scale));
+                h = max(1, (int)(images[i]->h * scale));
+            }
+            if (x + w + 2 > SPRITE_ATLAS_WIDTH) {
+                x = 0;
+                y += rowHeight + 2;
+                rowHeight = 0;
+            }
+            placed[i] = {x + 1, y + 1, w, h};
+            x += w + 2;
+            rowHeight = max(rowHeight, h);
+        }
+
+        int height = max(y + rowHeight + 2, 1);
+        SDL_Surface* sheet = SDL_CreateRGBSurfaceWithFormat(0, SPRITE_ATLAS_WIDTH, height, 32, SDL_PIXELFORMAT_RGBA32);
+        for (int i = 0; i < SPRITE_COUNT; i++) {
+            uv[i] = {(float)placed[i].x / SPRITE_ATLAS_WIDTH, (float)placed[i].y / height,
+                     (float)placed[i].w / SPRITE_ATLAS_WIDTH, (float)placed[i].h / height};
+            if (!images[i]) continue;
+            SDL_Surface* rgba = SDL_ConvertSurfaceFormat(images[i], SDL_PIXELFORMAT_RGBA32, 0);
+            SDL_SoftStretchLinear(rgba, NULL, sheet, &placed[i]);
+            SDL_FreeSurface(rgba);
+            SDL_FreeSurface(images[i]);
+        }
+        tex = SDL_CreateTextureFromSurface(renderer, sheet);
+        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+        SDL_SetTextureScaleMode(tex, SDL_ScaleModeLinear);
+        SDL_FreeSurface(sheet);
+    }
+
+    void destroy() {
+        SDL_DestroyTexture(tex);
+        tex = nullptr;
+    }
+};
 
-        SDL_RenderCopy(renderer, texture, NULL, &textRect);
+// Collects sprite quads for one frame, in submission order, and draws them
+// with one SDL_RenderGeometry call.
+struct SpriteBatch {
+    const SpriteAtlas* atlas = nullptr;
+    vector<SDL_Vertex> verts;
+    vector<int> indices;
+
+    // Room for this many sprites between flushes.
+    void reserve(int sprites) {
+        verts.reserve(sprites * 4);
+        indices.reserve(sprites * 6);
+    }
+
+    void add(int sprite, float x, float y, float w, float h) {
+        const SDL_FRect& uv = atlas->uv[sprite];
+        SDL_Color white = {255, 255, 255, 255};
+        int base = (int)verts.size();
+        verts.push_back({{x, y}, white, {uv.x, uv.y}});
+        verts.push_back({{x + w, y}, white, {uv.x + uv.w, uv.y}});
+        verts.push_back({{x + w, y + h}, white, {uv.x + uv.w, uv.y + uv.h}});
+        verts.push_back({{x, y + h}, white, {uv.x, uv.y + uv.h}});
+        int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+        indices.insert(indices.end(), quad, quad + 6);
+    }
 
-        SDL_FreeSurface(surface);
-        SDL_DestroyTexture(texture);
+    void flush(SDL_Renderer* renderer) {
+        if (!verts.empty()) {
+            SDL_RenderGeometry(renderer, atlas->tex, verts.data(), (int)verts.size(), indices.data(), (int)indices.size());
+            renderStats.draw(atlas->tex);
+        }
+        verts.clear();
+        indices.clear();
     }
 };
 
-struct Bullet {
-    SDL_Rect rect;
-    float vx, vy;
-    int texIndex;
+const int BULLET_SIZE = 30;
+const int BULLET_CAPACITY = 1024;
+const int MAX_BULLETS = 1 << 19;
+const int CULL_MARGIN = 64;
+
+// Fixed-capacity bullet storage with one contiguous array per field. The
+// previous step's position is kept so rendering can interpolate between
+// steps. Removal swaps the last bullet into the hole, so order is not kept.
+// Every step the velocity and acceleration are rotated by the bullet's turn
+// and the acceleration is added, so curving and speeding-up bullets share one
+// branch-free loop. Until such a bullet is spawned the pool takes a cheaper
+// loop that only touches positions. Each bullet also gets an id, increasing
+// in spawn order and never reused, for observers such as the spectator stream
+// that follow bullets from step to step; the simulation never reads it.
+struct BulletPool {
+    int capacity = 0;
+    int count = 0;
+    bool straight = true;
+    Uint32 nextId = 0;
+    vector<float> x, y;
+    vector<float> prevX, prevY;
+    vector<float> vx, vy; // pixels per second
+    vector<float> ax, ay; // pixels per second squared
+    vector<float> turnCos, turnSin; // rotation applied each step
+    vector<Uint8> texIndex;
+    vector<Uint32> id;
+
+    explicit BulletPool(int cap = BULLET_CAPACITY) {
+        setCapacity(cap);
+    }
+
+    void setCapacity(int cap) {
+        capacity = cap;
+        count = min(count, cap);
+        x.resize(cap);
+        y.resize(cap);
+        prevX.resize(cap);
+        prevY.resize(cap);
+        vx.resize(cap);
+        vy.resize(cap);
+        ax.resize(cap);
+        ay.resize(cap);
+        turnCos.resize(cap);
+        turnSin.resize(cap);
+        texIndex.resize(cap);
+        id.resize(cap);
+    }
+
+    // Doubles capacity up to MAX_BULLETS; false once there is no more room.
+    bool grow() {
+        if (capacity >= MAX_BULLETS) return false;
+        setCapacity(min(MAX_BULLETS, max(BULLET_CAPACITY, capacity * 2)));
+        return true;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    void clear() {
+        count = 0;
+        straight = true;
+    }
+
+    // accel is along the launch heading, turn in radians per second.
+    bool spawn(float px, float py, float pvx, float pvy, int tex, float accel = 0, float turn = 0) {
+        if (count == capacity) return false;
+        int i = count++;
+        x[i] = prevX[i] = px;
+        y[i] = prevY[i] = py;
+        vx[i] = pvx;
+        vy[i] = pvy;
+        float speed = sqrt(pvx * pvx + pvy * pvy);
+        ax[i] = speed > 0 ? pvx / speed * accel : 0;
+        ay[i] = speed > 0 ? pvy / speed * accel : 0;
+        turnCos[i] = turn != 0 ? cos(turn * SIM_DT) : 1;
+        turnSin[i] = turn != 0 ? sin(turn * SIM_DT) : 0;
+        if (accel != 0 || turn != 0) straight = false;
+        texIndex[i] = (Uint8)tex;
+        id[i] = nextId++;
+        return true;
+    }
+
+    void remove(int i) {
+        int last = --count;
+        x[i] = x[last];
+        y[i] = y[last];
+        prevX[i] = prevX[last];
+        prevY[i] = prevY[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        ax[i] = ax[last];
+        ay[i] = ay[last];
+        turnCos[i] = turnCos[last];
+        turnSin[i] = turnSin[last];
+        texIndex[i] = texIndex[last];
+        id[i] = id[last];
+    }
+
+    void copyFrom(const BulletPool& from, int src, int dst) {
+        x[dst] = from.x[src];
+        y[dst] = from.y[src];
+        prevX[dst] = from.prevX[src];
+        prevY[dst] = from.prevY[src];
+        vx[dst] = from.vx[src];
+        vy[dst] = from.vy[src];
+        texIndex[dst] = from.texIndex[src];
+        id[dst] = from.id[src];
+        if (!from.straight) {
+            ax[dst] = from.ax[src];
+            ay[dst] = from.ay[src];
+            turnCos[dst] = from.turnCos[src];
+            turnSin[dst] = from.turnSin[src];
+        }
+    }
+
+    void move(float dt) {
+        move(dt, 0, count);
+    }
+
+    // Advances bullets [begin, end) by ticks steps of dt. prev keeps the
+    // position before the whole move, which is what collision sweeps from.
+    // Every bullet is added up one tick at a time, so a span lands bit for
+    // bit where as many single steps would.
+    void move(float dt, int begin, int end, int ticks = 1) {
+        for (int i = begin; i < end; i++) {
+            prevX[i] = x[i];
+            prevY[i] = y[i];
+        }
+        if (straight) {
+            for (int t = 0; t < ticks; t++) {
+                for (int i = begin; i < end; i++) {
+                    x[i] += vx[i] * dt;
+                    y[i] += vy[i] * dt;
+                }
+            }
+            return;
+        }
+        for (int i = begin; i < end; i++) {
+            for (int t = 0; t < ticks; t++) advance(i, dt);
+        }
+    }
+
+    // One tick of bullet i, with the same arithmetic as move().
+    void advance(int i, float dt) {
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        if (straight) return;
+        float c = turnCos[i], s = turnSin[i];
+        float rax = ax[i] * c - ay[i] * s;
+        float ray = ax[i] * s + ay[i] * c;
+        float rvx = vx[i] * c - vy[i] * s;
+        float rvy = vx[i] * s + vy[i] * c;
+        ax[i] = rax;
+        ay[i] = ray;
+        vx[i] = rvx + rax * dt;
+        vy[i] = rvy + ray * dt;
+    }
+
+    SDL_Rect rect(int i) const {
+        return {(int)x[i], (int)y[i], BULLET_SIZE, BULLET_SIZE};
+    }
+
+    // Everything the bullet's box covered during the last move.
+    SDL_Rect sweptRect(int i) const {
+        int x0 = (int)floor(min(prevX[i], x[i])), y0 = (int)floor(min(prevY[i], y[i]));
+        int x1 = (int)ceil(max(prevX[i], x[i])), y1 = (int)ceil(max(prevY[i], y[i]));
+        return {x0, y0, x1 - x0 + BULLET_SIZE, y1 - y0 + BULLET_SIZE};
+    }
 
-    Bullet(int x, int y, float vx, float vy, int texIndex) {
-        rect = {x, y, 30, 30};
-        this->vx = vx;
-        this->vy = vy;
-        this->texIndex = texIndex;
+    // True once the bullet has left the playfield plus CULL_MARGIN.
+    bool offscreen(int i) const {
+        return outside(x[i], y[i]);
     }
 
-    void move() {
-        rect.x += vx;
-        rect.y += vy;
+    static bool outside(float px, float py) {
+        return px + BULLET_SIZE < -CULL_MARGIN || px > SCREEN_WIDTH + CULL_MARGIN ||
+               py + BULLET_SIZE < -CULL_MARGIN || py > SCREEN_HEIGHT + CULL_MARGIN;
     }
 
-    void render(SDL_Renderer* renderer, SDL_Texture* bulletTextures[6]) {
-        SDL_RenderCopy(renderer, bulletTextures[texIndex], NULL, &rect);
+    void render(SpriteBatch& batch, float alpha) const {
+        for (int i = 0; i < count; i++) {
+            batch.add(SPRITE_BULLET + texIndex[i], (int)(prevX[i] + (x[i] - prevX[i]) * alpha),
+                      (int)(prevY[i] + (y[i] - prevY[i]) * alpha), BULLET_SIZE, BULLET_SIZE);
+        }
     }
 };
 
 struct Player {
     SDL_Rect rect;
-    int speed = 4;
-    SDL_Texture* tex = nullptr;
+    float x = 0, y = 0;
+    float prevX = 0, prevY = 0;
+    float speed = 240.0f; // pixels per second
+    bool facingRight = true;
+
+    void placeAt(int px, int py) {
+        x = prevX = px;
+        y = prevY = py;
+        rect.x = px;
+        rect.y = py;
+    }
 
-    void moveTo(int targetX, int targetY) {
-        float dx = targetX - rect.x;
-        float dy = targetY - rect.y;
+    void moveTo(int targetX, int targetY, float dt) {
+        prevX = x;
+        prevY = y;
+        float dx = targetX - x;
+        float dy = targetY - y;
         float dist = sqrt(dx * dx + dy * dy);
-        if (dist > speed) {
-            rect.x += (dx / dist) * speed;
-            rect.y += (dy / dist) * speed;
+        float step = speed * dt;
+        if (dist > step) {
+            x += (dx / dist) * step;
+            y += (dy / dist) * step;
+        } else {
+            x = targetX;
+            y = targetY;
+        }
+        rect.x = (int)x;
+        rect.y = (int)y;
+    }
+
+    void render(SpriteBatch& batch, float alpha) const {
+        batch.add(facingRight ? SPRITE_PLAYER_RIGHT : SPRITE_PLAYER_LEFT, (int)(prevX + (x - prevX) * alpha),
+                  (int)(prevY + (y - prevY) * alpha), rect.w, rect.h);
+    }
+};
+
+// The first tick whose simulation time, in whole milliseconds, reaches ms.
+Uint32 firstTickAt(Uint32 ms) {
+    return (Uint32)(((Uint64)ms * SIM_HZ + 999) / 1000);
+}
+
+struct Shield {
+    SDL_Rect rect;
+    Uint32 spawnTime; // simulation milliseconds
+    int timer = -1;   // the owning Game's expiry timer
+    bool expired = false;
+
+    Shield(int x, int y, bool horizontal, Uint32 now) {
+        if (horizontal)
+            rect = {x - 50, y - 10, 100, 20};
+        else
+            rect = {x - 10, y - 50, 20, 100};
+        spawnTime = now;
+    }
+
+    // The first tick more than SHIELD_LIFETIME_MS after the spawn.
+    Uint32 expiryTick() const {
+        return firstTickAt(spawnTime + SHIELD_LIFETIME_MS + 1);
+    }
+
+    void render(SpriteBatch& batch) const {
+        batch.add(SPRITE_WALL, rect.x, rect.y, rect.w, rect.h);
+    }
+};
+
+struct ScoreEntry {
+    string name;
+    int score;
+
+    ScoreEntry(string n, int s) : name(n), score(s) {}
+};
+
+// xorshift128+ seeded through splitmix64. Every simulation owns one, so runs
+// are reproducible from their seed and independent of each other.
+struct Rng {
+    Uint64 s[2];
+
+    explicit Rng(Uint64 seed = 1) { reseed(seed); }
+
+    void reseed(Uint64 seed) {
+        for (int i = 0; i < 2; i++) {
+            seed += 0x9E3779B97F4A7C15ull;
+            Uint64 z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            s[i] = z ^ (z >> 31);
+        }
+    }
+
+    Uint64 next() {
+        Uint64 a = s[0];
+        const Uint64 b = s[1];
+        s[0] = b;
+        a ^= a << 23;
+        s[1] = a ^ b ^ (a >> 17) ^ (b >> 26);
+        return s[1] + b;
+    }
+
+    // Uniform integer in [0, n).
+    int range(int n) {
+        return (int)(((next() >> 32) * (Uint64)n) >> 32);
+    }
+};
+
+bool checkCollision(SDL_Rect a, SDL_Rect b) {
+    return SDL_HasIntersection(&a, &b);
+}
+
+SDL_Rect grownRect(SDL_Rect r, int by) {
+    return {r.x - by, r.y - by, r.w + 2 * by, r.h + 2 * by};
+}
+
+// Swept narrow phase for a batch of bullets against one rect. Each bullet's
+// size x size box travels in a straight line from (x0, y0) to (x1, y1) over
+// the step, and hit[i] gets bit OR-ed in if it touches r anywhere along the
+// way, so fast bullets and long steps cannot tunnel through a shield. In the
+// rect's frame the box's corner traces a segment, which is tested against r
+// grown by size on its left and top: the segment's bounding box has to
+// overlap the grown rect, and the rect's corners must not all lie on one side
+// of the segment's line. A rect that moved during the step (the player) is
+// given at its end position, with its motion in shiftX/shiftY; the start
+// points are shifted by it. Positions stay float throughout. sweepHit is the
+// reference; the SIMD versions must agree with it bit for bit.
+typedef void (*CollideBatchFn)(const float* x0, const float* y0, const float* x1, const float* y1, int n, float size,
+                               const SDL_Rect& r, float shiftX, float shiftY, Uint8* hit, Uint8 bit);
+
+inline bool sweepHit(float sx, float sy, float ex, float ey, float left, float top, float right, float bottom) {
+    if (min(sx, ex) >= right || max(sx, ex) <= left || min(sy, ey) >= bottom || max(sy, ey) <= top) return false;
+    float dx = ex - sx, dy = ey - sy;
+    float ax = (left - sx) * dy, bx = (right - sx) * dy;
+    float ay = (top - sy) * dx, by = (bottom - sy) * dx;
+    return min(ax, bx) - max(ay, by) <= 0 && max(ax, bx) - min(ay, by) >= 0;
+}
+
+void collideBatchScalar(const float* x0, const float* y0, const float* x1, const float* y1, int n, float size,
+                        const SDL_Rect& r, float shiftX, float shiftY, Uint8* hit, Uint8 bit) {
+    float left = r.x - size, right = (float)(r.x + r.w), top = r.y - size, bottom = (float)(r.y + r.h);
+    for (int i = 0; i < n; i++) {
+        if (sweepHit(x0[i] + shiftX, y0[i] + shiftY, x1[i], y1[i], left, top, right, bottom)) hit[i] |= bit;
+    }
+}
+
+#ifdef GAME_X86
+TARGET_SSE2 void collideBatchSSE2(const float* x0, const float* y0, const float* x1, const float* y1, int n, float size,
+                                  const SDL_Rect& r, float shiftX, float shiftY, Uint8* hit, Uint8 bit) {
+    float fl = r.x - size, fr = (float)(r.x + r.w), ft = r.y - size, fb = (float)(r.y + r.h);
+    const __m128 left = _mm_set1_ps(fl), right = _mm_set1_ps(fr), top = _mm_set1_ps(ft), bottom = _mm_set1_ps(fb);
+    const __m128 shx = _mm_set1_ps(shiftX), shy = _mm_set1_ps(shiftY), zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 sx = _mm_add_ps(_mm_loadu_ps(x0 + i), shx), sy = _mm_add_ps(_mm_loadu_ps(y0 + i), shy);
+        __m128 ex = _mm_loadu_ps(x1 + i), ey = _mm_loadu_ps(y1 + i);
+        __m128 box = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(_mm_min_ps(sx, ex), right), _mm_cmpgt_ps(_mm_max_ps(sx, ex), left)),
+                                _mm_and_ps(_mm_cmplt_ps(_mm_min_ps(sy, ey), bottom), _mm_cmpgt_ps(_mm_max_ps(sy, ey), top)));
+        __m128 dx = _mm_sub_ps(ex, sx), dy = _mm_sub_ps(ey, sy);
+        __m128 ax = _mm_mul_ps(_mm_sub_ps(left, sx), dy), bx = _mm_mul_ps(_mm_sub_ps(right, sx), dy);
+        __m128 ay = _mm_mul_ps(_mm_sub_ps(top, sy), dx), by = _mm_mul_ps(_mm_sub_ps(bottom, sy), dx);
+        __m128 lo = _mm_sub_ps(_mm_min_ps(ax, bx), _mm_max_ps(ay, by));
+        __m128 hi = _mm_sub_ps(_mm_max_ps(ax, bx), _mm_min_ps(ay, by));
+        __m128 m = _mm_and_ps(box, _mm_and_ps(_mm_cmple_ps(lo, zero), _mm_cmpge_ps(hi, zero)));
+        int bits = _mm_movemask_ps(m);
+        for (int k = 0; bits; k++, bits >>= 1) {
+            if (bits & 1) hit[i + k] |= bit;
+        }
+    }
+    for (; i < n; i++) {
+        if (sweepHit(x0[i] + shiftX, y0[i] + shiftY, x1[i], y1[i], fl, ft, fr, fb)) hit[i] |= bit;
+    }
+}
+
+TARGET_AVX2 void collideBatchAVX2(const float* x0, const float* y0, const float* x1, const float* y1, int n, float size,
+                                  const SDL_Rect& r, float shiftX, float shiftY, Uint8* hit, Uint8 bit) {
+    float fl = r.x - size, fr = (float)(r.x + r.w), ft = r.y - size, fb = (float)(r.y + r.h);
+    const __m256 left = _mm256_set1_ps(fl), right = _mm256_set1_ps(fr), top = _mm256_set1_ps(ft), bottom = _mm256_set1_ps(fb);
+    const __m256 shx = _mm256_set1_ps(shiftX), shy = _mm256_set1_ps(shiftY), zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 sx = _mm256_add_ps(_mm256_loadu_ps(x0 + i), shx), sy = _mm256_add_ps(_mm256_loadu_ps(y0 + i), shy);
+        __m256 ex = _mm256_loadu_ps(x1 + i), ey = _mm256_loadu_ps(y1 + i);
+        __m256 box = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(sx, ex), right, _CMP_LT_OQ),
+                                                 _mm256_cmp_ps(_mm256_max_ps(sx, ex), left, _CMP_GT_OQ)),
+                                   _mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(sy, ey), bottom, _CMP_LT_OQ),
+                                                 _mm256_cmp_ps(_mm256_max_ps(sy, ey), top, _CMP_GT_OQ)));
+        __m256 dx = _mm256_sub_ps(ex, sx), dy = _mm256_sub_ps(ey, sy);
+        __m256 ax = _mm256_mul_ps(_mm256_sub_ps(left, sx), dy), bx = _mm256_mul_ps(_mm256_sub_ps(right, sx), dy);
+        __m256 ay = _mm256_mul_ps(_mm256_sub_ps(top, sy), dx), by = _mm256_mul_ps(_mm256_sub_ps(bottom, sy), dx);
+        __m256 lo = _mm256_sub_ps(_mm256_min_ps(ax, bx), _mm256_max_ps(ay, by));
+        __m256 hi = _mm256_sub_ps(_mm256_max_ps(ax, bx), _mm256_min_ps(ay, by));
+        __m256 m = _mm256_and_ps(box, _mm256_and_ps(_mm256_cmp_ps(lo, zero, _CMP_LE_OQ), _mm256_cmp_ps(hi, zero, _CMP_GE_OQ)));
+        int bits = _mm256_movemask_ps(m);
+        for (int k = 0; bits; k++, bits >>= 1) {
+            if (bits & 1) hit[i + k] |= bit;
+        }
+    }
+    for (; i < n; i++) {
+        if (sweepHit(x0[i] + shiftX, y0[i] + shiftY, x1[i], y1[i], fl, ft, fr, fb)) hit[i] |= bit;
+    }
+}
+#endif
+
+CollideBatchFn pickCollideBatch() {
+#ifdef GAME_X86
+    if (SDL_HasAVX2()) return collideBatchAVX2;
+    if (SDL_HasSSE2()) return collideBatchSSE2;
+#endif
+    return collideBatchScalar;
+}
+
+CollideBatchFn collideBatch = pickCollideBatch();
+
+struct CollideKernel {
+    const char* name;
+    CollideBatchFn fn;
+};
+
+// The SIMD kernels this CPU can run, whichever one collideBatch picked.
+int simdCollideKernels(CollideKernel out[2]) {
+    int n = 0;
+#ifdef GAME_X86
+    if (SDL_HasSSE2()) out[n++] = CollideKernel{"sse2", collideBatchSSE2};
+    if (SDL_HasAVX2()) out[n++] = CollideKernel{"avx2", collideBatchAVX2};
+#endif
+    return n;
+}
+
+// Compares kernel with the scalar reference on random moves around random
+// rects, including bullets standing still, moves along an axis, boxes that
+// just touch and negative coordinates. Returns the number of mismatching
+// bullets.
+int verifyCollideBatch(CollideBatchFn kernel, Uint64 seed, int rounds) {
+    Rng rng(seed);
+    const int n = 257;
+    vector<float> x0(n), y0(n), x1(n), y1(n);
+    vector<Uint8> expected(n), actual(n);
+    int mismatches = 0;
+    for (int round = 0; round < rounds; round++) {
+        SDL_Rect r = {rng.range(400) - 100, rng.range(400) - 100, rng.range(120), rng.range(120)};
+        float shiftX = round % 2 ? rng.range(800) / 100.0f - 4 : 0;
+        float shiftY = round % 2 ? rng.range(800) / 100.0f - 4 : 0;
+        for (int i = 0; i < n; i++) {
+            x0[i] = r.x - 40 + rng.range(20000) / 100.0f;
+            y0[i] = r.y - 40 + rng.range(20000) / 100.0f;
+            int kind = rng.range(4);
+            x1[i] = kind == 0 || kind == 1 ? x0[i] : r.x - 200 + rng.range(60000) / 100.0f;
+            y1[i] = kind == 0 || kind == 2 ? y0[i] : r.y - 200 + rng.range(60000) / 100.0f;
+        }
+        fill(expected.begin(), expected.end(), 0);
+        fill(actual.begin(), actual.end(), 0);
+        collideBatchScalar(x0.data(), y0.data(), x1.data(), y1.data(), n, BULLET_SIZE, r, shiftX, shiftY, expected.data(), 1);
+        kernel(x0.data(), y0.data(), x1.data(), y1.data(), n, BULLET_SIZE, r, shiftX, shiftY, actual.data(), 1);
+        for (int i = 0; i < n; i++) mismatches += expected[i] != actual[i];
+    }
+    return mismatches;
+}
+
+// Checks every SIMD kernel the CPU runs, not just the selected one, and
+// names each one that disagrees; with verbose, the ones that agree too.
+// Returns the number of kernels that failed.
+int verifyCollideKernels(Uint64 seed, int rounds, bool verbose) {
+    CollideKernel kernels[2];
+    int count = simdCollideKernels(kernels), failed = 0;
+    for (int k = 0; k < count; k++) {
+        int mismatches = verifyCollideBatch(kernels[k].fn, seed, rounds);
+        if (mismatches || verbose) {
+            printf("collide_%s %s: %d of %d bullets disagree with sweepHit\n", kernels[k].name,
+                   mismatches ? "FAILED" : "ok", mismatches, rounds * 257);
+        }
+        failed += mismatches != 0;
+    }
+    if (verbose && count == 0) printf("no SIMD collision kernels on this CPU; scalar only\n");
+    return failed;
+}
+
+// Uniform grid over the playfield plus CULL_MARGIN, used as the collision
+// broadphase. Colliders are added and the grid rebuilt once per step; queries
+// then only look at the cells they overlap and report each collider once.
+const int GRID_CELL = 64;
+const size_t BROADPHASE_MIN_SHIELDS = 8;
+
+const Uint8 HIT_SHIELD = 1;
+const Uint8 HIT_PLAYER = 2;
+const Uint8 HIT_GONE = 4; // bullet hell: culled this step, for whatever reason
+
+struct SpatialGrid {
+    int cols = (SCREEN_WIDTH + 2 * CULL_MARGIN + GRID_CELL - 1) / GRID_CELL;
+    int rows = (SCREEN_HEIGHT + 2 * CULL_MARGIN + GRID_CELL - 1) / GRID_CELL;
+    vector<SDL_Rect> boxes;
+    vector<int> cellStart = vector<int>(cols * rows, 0); // offset into cellItems
+    vector<int> cellCount = vector<int>(cols * rows, 0);
+    vector<int> cellItems;
+    vector<int> touched; // non-empty cells, so a rebuild only resets those
+    vector<Uint32> stamp;
+    Uint32 queryId = 0;
+
+    void clear() {
+        boxes.clear();
+    }
+
+    // Returns the collider's id, which is its insertion index.
+    int add(const SDL_Rect& box) {
+        boxes.push_back(box);
+        return (int)boxes.size() - 1;
+    }
+
+    void cellRange(const SDL_Rect& box, int& c0, int& r0, int& c1, int& r1) const {
+        c0 = max(0, min(cols - 1, (box.x + CULL_MARGIN) / GRID_CELL));
+        r0 = max(0, min(rows - 1, (box.y + CULL_MARGIN) / GRID_CELL));
+        c1 = max(0, min(cols - 1, (box.x + box.w + CULL_MARGIN) / GRID_CELL));
+        r1 = max(0, min(rows - 1, (box.y + box.h + CULL_MARGIN) / GRID_CELL));
+    }
+
+    // Counting sort of colliders into the cells they overlap.
+    void build() {
+        for (int cell : touched) cellCount[cell] = 0;
+        touched.clear();
+
+        int c0, r0, c1, r1;
+        for (auto& box : boxes) {
+            cellRange(box, c0, r0, c1, r1);
+            for (int r = r0; r <= r1; r++) {
+                for (int c = c0; c <= c1; c++) {
+                    if (cellCount[r * cols + c]++ == 0) touched.push_back(r * cols + c);
+                }
+            }
+        }
+        int total = 0;
+        for (int cell : touched) {
+            cellStart[cell] = total;
+            total += cellCount[cell];
+            cellCount[cell] = 0;
+        }
+        cellItems.resize(total);
+        for (int id = 0; id < (int)boxes.size(); id++) {
+            cellRange(boxes[id], c0, r0, c1, r1);
+            for (int r = r0; r <= r1; r++) {
+                for (int c = c0; c <= c1; c++) {
+                    int cell = r * cols + c;
+                    cellItems[cellStart[cell] + cellCount[cell]++] = id;
+                }
+            }
+        }
+        stamp.assign(boxes.size(), queryId);
+    }
+
+    // Appends the ids of colliders whose box intersects area.
+    void queryAABB(const SDL_Rect& area, vector<int>& out) {
+        int c0, r0, c1, r1;
+        cellRange(area, c0, r0, c1, r1);
+        queryId++;
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                int cell = r * cols + c;
+                for (int k = cellStart[cell]; k < cellStart[cell] + cellCount[cell]; k++) {
+                    int id = cellItems[k];
+                    if (stamp[id] == queryId) continue;
+                    stamp[id] = queryId;
+                    if (checkCollision(area, boxes[id])) out.push_back(id);
+                }
+            }
+        }
+    }
+
+    // Appends the ids of colliders whose box comes within radius of (cx, cy).
+    void queryRadius(float cx, float cy, float radius, vector<int>& out) {
+        SDL_Rect area = {(int)floor(cx - radius), (int)floor(cy - radius), (int)ceil(2 * radius) + 1, (int)ceil(2 * radius) + 1};
+        int c0, r0, c1, r1;
+        cellRange(area, c0, r0, c1, r1);
+        queryId++;
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                int cell = r * cols + c;
+                for (int k = cellStart[cell]; k < cellStart[cell] + cellCount[cell]; k++) {
+                    int id = cellItems[k];
+                    if (stamp[id] == queryId) continue;
+                    stamp[id] = queryId;
+                    const SDL_Rect& b = boxes[id];
+                    float nx = max((float)b.x, min(cx, (float)(b.x + b.w)));
+                    float ny = max((float)b.y, min(cy, (float)(b.y + b.h)));
+                    if ((nx - cx) * (nx - cx) + (ny - cy) * (ny - cy) <= radius * radius) out.push_back(id);
+                }
+            }
+        }
+    }
+};
+
+// Every recorded run, ranked by score (ties keep arrival order). An
+// order-statistic treap gives O(log n) insert, rank-of-score and top-N.
+// Player names repeat a lot, so nodes refer to an interned name table.
+struct Leaderboard {
+    struct Node {
+        int score;
+        Uint32 seq;
+        Uint32 priority;
+        int left, right, size;
+        int name;
+    };
+
+    vector<Node> nodes;
+    vector<string> names;
+    map<string, int> nameIds;
+    int root = -1;
+    Uint32 nextSeq = 0;
+    Rng rng{0x5EED1EADull};
+
+    int size() const {
+        return (int)nodes.size();
+    }
+
+    int sizeOf(int t) const {
+        return t < 0 ? 0 : nodes[t].size;
+    }
+
+    void update(int t) {
+        nodes[t].size = 1 + sizeOf(nodes[t].left) + sizeOf(nodes[t].right);
+    }
+
+    bool before(int t, int score, Uint32 seq) const {
+        return nodes[t].score > score || (nodes[t].score == score && nodes[t].seq < seq);
+    }
+
+    // Splits t into the entries ranked before (score, seq) and the rest.
+    void split(int t, int score, Uint32 seq, int& l, int& r) {
+        if (t < 0) {
+            l = r = -1;
+        } else if (before(t, score, seq)) {
+            split(nodes[t].right, score, seq, nodes[t].right, r);
+            l = t;
+            update(t);
+        } else {
+            split(nodes[t].left, score, seq, l, nodes[t].left);
+            r = t;
+            update(t);
+        }
+    }
+
+    // Joins two treaps where every entry of a ranks before every entry of b.
+    int merge(int a, int b) {
+        if (a < 0) return b;
+        if (b < 0) return a;
+        if (nodes[a].priority > nodes[b].priority) {
+            int right = merge(nodes[a].right, b);
+            nodes[a].right = right;
+            update(a);
+            return a;
+        }
+        int left = merge(a, nodes[b].left);
+        nodes[b].left = left;
+        update(b);
+        return b;
+    }
+
+    // Adds an entry without linking it into the tree; rebuild() must follow.
+    // Used for bulk loads, which are much cheaper sorted than inserted.
+    void append(const string& name, int score) {
+        auto id = nameIds.insert(make_pair(name, (int)names.size()));
+        if (id.second) names.push_back(name);
+        Node node = {score, nextSeq++, (Uint32)rng.next(), -1, -1, 1, id.first->second};
+        nodes.push_back(node);
+    }
+
+    // Returns the new entry's 1-based rank.
+    int insert(const string& name, int score) {
+        append(name, score);
+        const Node& node = nodes.back();
+        int l, r;
+        split(root, node.score, node.seq, l, r);
+        int rank = sizeOf(l) + 1;
+        root = merge(merge(l, (int)nodes.size() - 1), r);
+        return rank;
+    }
+
+    // Relinks every node: sort by rank, then build the treap over that order
+    // in one pass with a stack, and fill in subtree sizes bottom-up.
+    void rebuild() {
+        vector<int> order(nodes.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+        sort(order.begin(), order.end(), [this](int a, int b) { return before(a, nodes[b].score, nodes[b].seq); });
+
+        vector<int> stack;
+        for (int t : order) {
+            nodes[t].left = nodes[t].right = -1;
+            int last = -1;
+            while (!stack.empty() && nodes[stack.back()].priority < nodes[t].priority) {
+                last = stack.back();
+                stack.pop_back();
+            }
+            nodes[t].left = last;
+            if (!stack.empty()) nodes[stack.back()].right = t;
+            stack.push_back(t);
+        }
+        root = stack.empty() ? -1 : stack.front();
+
+        // Children always come before parents in reverse preorder.
+        vector<int> preorder;
+        if (root >= 0) stack.assign(1, root);
+        while (!stack.empty()) {
+            int t = stack.back();
+            stack.pop_back();
+            preorder.push_back(t);
+            if (nodes[t].left >= 0) stack.push_back(nodes[t].left);
+            if (nodes[t].right >= 0) stack.push_back(nodes[t].right);
+        }
+        for (size_t i = preorder.size(); i-- > 0;) update(preorder[i]);
+    }
+
+    // Rank a new run with this score would get.
+    int rankOf(int score) const {
+        int rank = 1;
+        for (int t = root; t >= 0;) {
+            if (nodes[t].score >= score) {
+                rank += sizeOf(nodes[t].left) + 1;
+                t = nodes[t].right;
+            } else {
+                t = nodes[t].left;
+            }
+        }
+        return rank;
+    }
+
+    int highest() const {
+        int t = root;
+        while (t >= 0 && nodes[t].left >= 0) t = nodes[t].left;
+        return t < 0 ? 0 : nodes[t].score;
+    }
+
+    vector<ScoreEntry> top(int n) const {
+        vector<ScoreEntry> out;
+        vector<int> stack;
+        int t = root;
+        while ((t >= 0 || !stack.empty()) && (int)out.size() < n) {
+            while (t >= 0) {
+                stack.push_back(t);
+                t = nodes[t].left;
+            }
+            t = stack.back();
+            stack.pop_back();
+            out.push_back(ScoreEntry(names[nodes[t].name], nodes[t].score));
+            t = nodes[t].right;
+        }
+        return out;
+    }
+};
+
+bool replaceFile(const string& from, const string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Flushes f and waits until it is on disk; false if either step failed.
+bool syncFile(FILE* f) {
+    if (fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Persists leaderboard entries without blocking the game. New scores are
+// appended to a log by a worker thread, which also folds the log into the
+// snapshot once it grows past a quarter of it: the merged snapshot goes to a
+// temp file that is synced and renamed over the old one. Log lines carry a
+// sequence number and the snapshot starts with "#seq N", so log entries that
+// already made it into a snapshot are skipped if we crash before truncating.
+// Scores the log could not take stay queued and are retried.
+const int LEADERBOARD_MIN_COMPACT = 256;
+const int LEADERBOARD_RETRY_MS = 1000;
+
+struct LeaderboardStore {
+    struct Record {
+        Uint64 seq;
+        string name;
+        int score;
+    };
+
+    string snapshotPath, logPath;
+    Uint64 snapshotSeq = 0; // highest log sequence folded into the snapshot
+    Uint64 nextSeq = 1;
+    int snapshotEntries = 0;
+    int logEntries = 0;
+
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    vector<Record> pending;
+    bool stopping = false;
+
+    // Reads the snapshot and any log written after it into board, then starts
+    // the writer thread.
+    void open(const string& snapshot, const string& log, Leaderboard& board) {
+        snapshotPath = snapshot;
+        logPath = log;
+
+        char name[128];
+        int score;
+        unsigned long long seq;
+        if (FILE* f = fopen(snapshotPath.c_str(), "r")) {
+            char line[256];
+            while (fgets(line, sizeof(line), f)) {
+                if (sscanf(line, "#seq %llu", &seq) == 1) {
+                    snapshotSeq = seq;
+                } else if (sscanf(line, "%127s %d", name, &score) == 2) {
+                    board.append(name, score);
+                    snapshotEntries++;
+                }
+            }
+            fclose(f);
+        }
+        nextSeq = snapshotSeq + 1;
+        set<Uint64> seen; // a batch retried after a failed append can repeat
+        if (FILE* f = fopen(logPath.c_str(), "r")) {
+            while (fscanf(f, "%llu %127s %d", &seq, name, &score) == 3) {
+                if (seq <= snapshotSeq || !seen.insert(seq).second) continue;
+                board.append(name, score);
+                logEntries++;
+                nextSeq = max(nextSeq, (Uint64)seq + 1);
+            }
+            fclose(f);
+        }
+        board.rebuild();
+
+        worker = thread([this] { run(); });
+    }
+
+    void append(const string& name, int score) {
+        lock_guard<mutex> guard(lock);
+        pending.push_back(Record{nextSeq++, name, score});
+        wake.notify_one();
+    }
+
+    void close() {
+        if (!worker.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    void run() {
+        vector<Record> batch;
+        bool failed = false;
+        for (;;) {
+            bool stop;
+            {
+                unique_lock<mutex> guard(lock);
+                if (failed) {
+                    wake.wait_for(guard, chrono::milliseconds(LEADERBOARD_RETRY_MS), [this] { return stopping; });
+                } else {
+                    wake.wait(guard, [this] { return stopping || !pending.empty(); });
+                }
+                batch.swap(pending);
+                stop = stopping;
+            }
+            failed = false;
+            if (!batch.empty()) {
+                int written = 0;
+                if (FILE* f = fopen(logPath.c_str(), "a")) {
+                    for (auto& r : batch) {
+                        if (fprintf(f, "%llu %s %d\n", (unsigned long long)r.seq, r.name.c_str(), r.score) < 0) break;
+                        written++;
+                    }
+                    // Lines only count once they are out of the stdio buffer.
+                    // A batch that may have partly landed goes again whole.
+                    if (fflush(f) != 0 || ferror(f)) written = 0;
+                    if (fclose(f) != 0) written = 0;
+                }
+                if (written < (int)batch.size()) {
+                    batch.erase(batch.begin(), batch.begin() + written);
+                    SDL_Log("cannot append to %s; %d scores %s", logPath.c_str(), (int)batch.size(),
+                            stop ? "go straight into the snapshot" : "will be retried");
+                    if (!stop) {
+                        lock_guard<mutex> guard(lock);
+                        pending.insert(pending.begin(), batch.begin(), batch.end());
+                        batch.clear();
+                        failed = true;
+                    }
+                } else {
+                    batch.clear();
+                }
+                logEntries += written;
+            }
+            if (stop) {
+                if ((logEntries > 0 || !batch.empty()) && !compact(batch) && !batch.empty()) {
+                    SDL_Log("cannot write %s either; %d scores are lost", snapshotPath.c_str(), (int)batch.size());
+                }
+                return;
+            }
+            if (logEntries > 0 && logEntries >= max(LEADERBOARD_MIN_COMPACT, snapshotEntries / 4)) compact();
+        }
+    }
+
+    // Writes the merged snapshot, with extra records the log never took, and
+    // truncates the log. Anything that goes wrong before the rename leaves
+    // the old snapshot, the log and the counts as they were; false then.
+    bool compact(const vector<Record>& extra = vector<Record>()) {
+        string tmpPath = snapshotPath + ".tmp";
+        FILE* out = fopen(tmpPath.c_str(), "w");
+        if (!out) return false;
+
+        Uint64 lastSeq = snapshotSeq;
+        int entries = 0;
+        char line[256], name[128];
+        int score;
+        unsigned long long seq;
+        vector<string> body;
+        set<Uint64> seen;
+        if (FILE* log = fopen(logPath.c_str(), "r")) {
+            while (fscanf(log, "%llu %127s %d", &seq, name, &score) == 3) {
+                if (seq <= snapshotSeq || !seen.insert(seq).second) continue;
+                body.push_back(string(name) + " " + to_string(score) + "\n");
+                lastSeq = max(lastSeq, (Uint64)seq);
+            }
+            fclose(log);
+        }
+        for (auto& r : extra) {
+            if (r.seq <= snapshotSeq || !seen.insert(r.seq).second) continue;
+            body.push_back(r.name + " " + to_string(r.score) + "\n");
+            lastSeq = max(lastSeq, r.seq);
+        }
+        fprintf(out, "#seq %llu\n", (unsigned long long)lastSeq);
+        if (FILE* in = fopen(snapshotPath.c_str(), "r")) {
+            while (fgets(line, sizeof(line), in)) {
+                if (line[0] == '#' || sscanf(line, "%127s %d", name, &score) != 2) continue;
+                fprintf(out, "%s %d\n", name, score);
+                entries++;
+            }
+            fclose(in);
+        }
+        for (auto& l : body) fputs(l.c_str(), out);
+        entries += (int)body.size();
+        bool ok = syncFile(out) && !ferror(out);
+        ok = fclose(out) == 0 && ok;
+
+        if (!ok || !replaceFile(tmpPath, snapshotPath)) {
+            SDL_Log("cannot write %s; keeping the old snapshot and log", tmpPath.c_str());
+            remove(tmpPath.c_str());
+            return false;
+        }
+        snapshotSeq = lastSeq;
+        snapshotEntries = entries;
+        logEntries = 0;
+        if (FILE* log = fopen(logPath.c_str(), "w")) fclose(log);
+        return true;
+    }
+};
+
+// Picks a point just off a random edge of the playfield and returns which
+// edge: 0 bottom, 1 left, 2 top, 3 right.
+int randomEdgePoint(Rng& rng, int& x, int& y) {
+    int side = rng.range(4);
+    switch (side) {
+        case 0: x = rng.range(SCREEN_WIDTH); y = SCREEN_HEIGHT + 20; break;
+        case 1: x = -20; y = rng.range(SCREEN_HEIGHT); break;
+        case 2: x = rng.range(SCREEN_WIDTH); y = -20; break;
+        case 3: x = SCREEN_WIDTH + 20; y = rng.range(SCREEN_HEIGHT); break;
+    }
+    return side;
+}
+
+// Fixed set of worker threads for data-parallel loops. parallelFor deals each
+// thread a contiguous run of chunk indices; a thread takes chunks from the
+// front of its own run and, once that is empty, steals from the back of the
+// others'. A run is a (begin, end) pair packed into one atomic word, so the
+// owner and a thief settle every chunk with a single compare-and-swap. The
+// calling thread works too and returns once every chunk has run.
+struct JobPool {
+    struct Run {
+        atomic<Uint64> span{0};
+        char pad[56]; // keep runs on separate cache lines
+    };
+
+    int threads = 1;
+    vector<thread> workers;
+    unique_ptr<Run[]> runs;
+    function<void(int)> task;
+
+    mutex lock;
+    condition_variable wake, finished;
+    Uint64 round = 0;
+    int pending = 0;
+    bool stopping = false;
+
+    static Uint64 pack(Uint32 begin, Uint32 end) {
+        return (Uint64)end << 32 | begin;
+    }
+
+    void start(int n) {
+        threads = max(1, n);
+        runs.reset(new Run[threads]);
+        for (int i = 1; i < threads; i++) workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+        workers.clear();
+        threads = 1;
+    }
+
+    bool take(int self, int& chunk) {
+        Run& own = runs[self];
+        Uint64 s = own.span.load(memory_order_relaxed);
+        while ((Uint32)s < (Uint32)(s >> 32)) {
+            if (own.span.compare_exchange_weak(s, s + 1, memory_order_acq_rel)) {
+                chunk = (int)(Uint32)s;
+                return true;
+            }
+        }
+        for (int k = 1; k < threads; k++) {
+            Run& victim = runs[(self + k) % threads];
+            Uint64 v = victim.span.load(memory_order_relaxed);
+            while ((Uint32)v < (Uint32)(v >> 32)) {
+                Uint32 last = (Uint32)(v >> 32) - 1;
+                if (victim.span.compare_exchange_weak(v, pack((Uint32)v, last), memory_order_acq_rel)) {
+                    chunk = (int)last;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void work(int self) {
+        for (int chunk; take(self, chunk);) task(chunk);
+    }
+
+    // Calls fn(chunk) once for every chunk in [0, chunks).
+    template <class F>
+    void parallelFor(int chunks, F fn) {
+        if (threads == 1 || chunks <= 1) {
+            for (int c = 0; c < chunks; c++) fn(c);
+            return;
+        }
+        task = fn;
+        for (int w = 0; w < threads; w++) {
+            runs[w].span.store(pack((Uint32)((Uint64)chunks * w / threads), (Uint32)((Uint64)chunks * (w + 1) / threads)),
+                               memory_order_relaxed);
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            pending = threads - 1;
+            round++;
+        }
+        wake.notify_all();
+        work(0);
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [this] { return pending == 0; });
+    }
+
+    void workerLoop(int self) {
+        Uint64 seen = 0;
+        for (;;) {
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || round != seen; });
+                if (stopping) return;
+                seen = round;
+            }
+            work(self);
+            lock_guard<mutex> guard(lock);
+            if (--pending == 0) finished.notify_one();
+        }
+    }
+};
+
+// Shared by everything that simulates; sized by --threads at startup.
+JobPool jobs;
+
+int threadsArg(const char* value) {
+    int n = value ? atoi(value) : 0;
+    return n > 0 ? n : max(1, (int)thread::hardware_concurrency());
+}
+
+// Bullet hell: spawns per tick ramp from 1 to HELL_MAX_SPAWNS over
+// HELL_RAMP_SECONDS, holding a few hundred thousand bullets at the peak.
+// Bullets cross the field towards random points and the player can take
+// HELL_HEALTH hits. Updates run in HELL_CHUNK-sized chunks on the job pool.
+enum GameMode {
+    MODE_CLASSIC, MODE_BULLET_HELL
+};
+
+const int HELL_MAX_SPAWNS = 800;
+const int HELL_RAMP_SECONDS = 30;
+const int HELL_HEALTH = 20000;
+const int HELL_CHUNK = 4096;
+const int HELL_AIMED_EVERY = 64;
+
+int hellSpawnsPerTick(Uint32 tick) {
+    return min(HELL_MAX_SPAWNS, 1 + (int)((Uint64)tick * HELL_MAX_SPAWNS / (HELL_RAMP_SECONDS * SIM_HZ)));
+}
+
+void spawnHellBullet(BulletPool& bullets, int playerX, int playerY, Rng& rng) {
+    int x, y;
+    int side = randomEdgePoint(rng, x, y);
+    int aimX = rng.range(SCREEN_WIDTH);
+    int aimY = rng.range(SCREEN_HEIGHT);
+    if (rng.range(HELL_AIMED_EVERY) == 0) {
+        aimX = playerX;
+        aimY = playerY;
+    }
+
+    float dx = aimX - x;
+    float dy = aimY - y;
+    float len = max(1.0f, sqrt(dx * dx + dy * dy));
+    float speed = (5 + rng.range(5)) * 60.0f;
+    bullets.spawn(x, y, dx / len * speed, dy / len * speed, side);
+}
+
+// Bullet patterns are data: patterns.txt (or the copy built in below) lists
+// patterns, small programs run by emitters, and waves, schedules saying when
+// and where emitters start. Times are milliseconds, angles degrees, speeds
+// pixels per second.
+//
+//   pattern <name>           wave <name>
+//     sprite <n>|edge          every <ms> <pattern> <where> [start <ms>] [until <ms>]
+//     speed <min> [max]        at <ms> <pattern> <where>
+//     accel <px/s^2>         end
+//     turn <deg/s>
+//     aim player|<deg>       <where> is edge (just off a random edge), random,
+//     rotate <deg>           center, or <x> <y>. `sprite edge` picks the bullet
+//     ring <n>               image by the edge the emitter started on. Shots
+//     fan <n> <spread>       take the emitter's current sprite, speed, accel
+//     wait <ms>              and turn; ring spaces n shots evenly around the
+//     repeat <n> ... end     heading, fan spreads them over <spread> degrees.
+//   end
+//
+// Patterns compile into one flat instruction table and waves into a list of
+// entries with tick times, so a tick walks plain arrays with a switch: no
+// virtual calls and no allocation once the emitter and bullet arrays have
+// grown.
+const char* PATTERN_FILE = "patterns.txt";
+const int PATTERN_MAX_DEPTH = 4;
+const int PATTERN_MAX_OPS_PER_TICK = 256;
+const float DEG = 0.017453292f;
+
+const char* DEFAULT_PATTERNS =
+    "# Classic mode: one bullet type every half second, in rotation.\n"
+    "pattern aimed\n"
+    "  sprite edge\n"
+    "  speed 300 540\n"
+    "  aim player\n"
+    "  fan 1 0\n"
+    "end\n"
+    "\n"
+    "# Bends off its line as it flies.\n"
+    "pattern swerve\n"
+    "  sprite 4\n"
+    "  speed 300 480\n"
+    "  turn 20\n"
+    "  aim player\n"
+    "  rotate -10\n"
+    "  fan 1 0\n"
+    "end\n"
+    "\n"
+    "# Starts slow and keeps speeding up.\n"
+    "pattern rush\n"
+    "  sprite 5\n"
+    "  speed 120 200\n"
+    "  accel 400\n"
+    "  aim player\n"
+    "  fan 1 0\n"
+    "end\n"
+    "\n"
+    "pattern spiral\n"
+    "  sprite 4\n"
+    "  speed 180\n"
+    "  aim 0\n"
+    "  repeat 36\n"
+    "    ring 3\n"
+    "    rotate 13\n"
+    "    wait 120\n"
+    "  end\n"
+    "end\n"
+    "\n"
+    "pattern burst\n"
+    "  sprite 5\n"
+    "  speed 260 320\n"
+    "  repeat 3\n"
+    "    aim player\n"
+    "    fan 5 40\n"
+    "    wait 250\n"
+    "  end\n"
+    "end\n"
+    "\n"
+    "wave classic\n"
+    "  every 1500 aimed edge start 500\n"
+    "  every 1500 swerve edge start 1000\n"
+    "  every 1500 rush edge start 1500\n"
+    "  every 20000 spiral center start 30000\n"
+    "  every 12000 burst edge start 45000\n"
+    "end\n";
+
+enum PatternOpCode {
+    OP_END, OP_SPRITE, OP_SPEED, OP_ACCEL, OP_TURN, OP_AIM_PLAYER, OP_HEADING, OP_ROTATE,
+    OP_RING, OP_FAN, OP_WAIT, OP_REPEAT, OP_LOOP
+};
+
+struct PatternOp {
+    Uint8 code;
+    int n;      // sprite, shot count, ticks to wait, repeat count or loop target
+    float a, b; // speeds, accel, radians
+};
+
+enum EmitterOrigin {
+    ORIGIN_EDGE, ORIGIN_RANDOM, ORIGIN_CENTER, ORIGIN_POINT
+};
+
+struct WaveEntry {
+    int pattern; // first op
+    Uint32 start, period, until; // ticks; period 0 fires once, until 0 never stops
+    EmitterOrigin origin;
+    float x, y;
+};
+
+struct PatternSet {
+    vector<PatternOp> ops;
+    map<string, int> entry;
+    map<string, vector<WaveEntry>> waves;
+    Uint64 hash = 0;
+
+    static Uint32 msToTicks(double ms) {
+        return (Uint32)(ms * SIM_HZ / 1000.0 + 0.5);
+    }
+
+    // Compiles the whole text or nothing; on failure error names the line.
+    bool compile(const string& text, string& error) {
+        PatternSet out;
+        vector<int> loops;
+        vector<pair<string, size_t>> uses; // (wave, entry) waiting for its pattern
+        vector<string> useNames;
+        string pattern, wave;
+        int lineNumber = 0;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t eol = text.find('\n', pos);
+            if (eol == string::npos) eol = text.size();
+            string line = text.substr(pos, eol - pos);
+            pos = eol + 1;
+            lineNumber++;
+            if (line.find('#') != string::npos) line.erase(line.find('#'));
+
+            vector<string> w;
+            for (size_t i = 0; i < line.size();) {
+                while (i < line.size() && isspace((unsigned char)line[i])) i++;
+                size_t j = i;
+                while (j < line.size() && !isspace((unsigned char)line[j])) j++;
+                if (j > i) w.push_back(line.substr(i, j - i));
+                i = j;
+            }
+            if (w.empty()) continue;
+
+            auto fail = [&](const char* what) {
+                error = "line " + to_string(lineNumber) + ": " + what;
+                return false;
+            };
+            auto number = [&](size_t i, double& v) {
+                char* endp = nullptr;
+                v = i < w.size() ? strtod(w[i].c_str(), &endp) : 0;
+                return i < w.size() && endp && *endp == '\0';
+            };
+            double a = 0, b = 0;
+            const string& op = w[0];
+
+            if (pattern.empty() && wave.empty()) {
+                if (w.size() != 2 || (op != "pattern" && op != "wave")) return fail("expected 'pattern <name>' or 'wave <name>'");
+                if (op == "pattern") {
+                    if (out.entry.count(w[1])) return fail("pattern defined twice");
+                    pattern = w[1];
+                    out.entry[pattern] = (int)out.ops.size();
+                } else {
+                    wave = w[1];
+                    out.waves[wave];
+                }
+            } else if (!wave.empty()) {
+                if (op == "end") {
+                    wave.clear();
+                    continue;
+                }
+                WaveEntry e = {};
+                size_t i = 1;
+                if (op == "every" && number(i, a)) {
+                    e.period = max(1u, msToTicks(a));
+                    e.start = 1;
+                } else if (op == "at" && number(i, a)) {
+                    e.start = max(1u, msToTicks(a));
+                } else {
+                    return fail("expected 'every <ms>' or 'at <ms>'");
+                }
+                if (++i >= w.size()) return fail("missing pattern name");
+                // Patterns may be defined further down; resolved below.
+                e.pattern = -1;
+                string name = w[i++];
+                if (i >= w.size()) return fail("missing where");
+                if (w[i] == "edge") {
+                    e.origin = ORIGIN_EDGE;
+                } else if (w[i] == "random") {
+                    e.origin = ORIGIN_RANDOM;
+                } else if (w[i] == "center") {
+                    e.origin = ORIGIN_CENTER;
+                } else if (number(i, a) && number(i + 1, b)) {
+                    e.origin = ORIGIN_POINT;
+                    e.x = (float)a;
+                    e.y = (float)b;
+                    i++;
+                } else {
+                    return fail("where must be edge, random, center or <x> <y>");
+                }
+                for (i++; i < w.size(); i += 2) {
+                    if (!number(i + 1, a)) return fail("expected a time after start/until");
+                    if (w[i] == "start" && op == "every") {
+                        e.start = max(1u, msToTicks(a));
+                    } else if (w[i] == "until" && op == "every") {
+                        e.until = msToTicks(a);
+                    } else {
+                        return fail("unknown wave option");
+                    }
+                }
+                uses.push_back(make_pair(wave, out.waves[wave].size()));
+                useNames.push_back(name);
+                out.waves[wave].push_back(e);
+            } else if (op == "end") {
+                if (loops.empty()) {
+                    out.ops.push_back(PatternOp{OP_END, 0, 0, 0});
+                    pattern.clear();
+                } else {
+                    out.ops.push_back(PatternOp{OP_LOOP, loops.back(), 0, 0});
+                    loops.pop_back();
+                }
+            } else if (op == "sprite") {
+                if (w.size() == 2 && w[1] == "edge") {
+                    out.ops.push_back(PatternOp{OP_SPRITE, -1, 0, 0});
+                } else if (number(1, a) && a >= 0 && a < SPRITE_WALL) {
+                    out.ops.push_back(PatternOp{OP_SPRITE, (int)a, 0, 0});
+                } else {
+                    return fail("sprite must be edge or a bullet image 0-5");
+                }
+            } else if (op == "speed" && number(1, a)) {
+                if (!number(2, b)) b = a;
+                if (b < a) return fail("speed max below min");
+                out.ops.push_back(PatternOp{OP_SPEED, 0, (float)a, (float)b});
+            } else if ((op == "accel" || op == "turn" || op == "rotate") && number(1, a)) {
+                Uint8 code = op == "accel" ? OP_ACCEL : op == "turn" ? OP_TURN : OP_ROTATE;
+                out.ops.push_back(PatternOp{code, 0, (float)(code == OP_ACCEL ? a : a * DEG), 0});
+            } else if (op == "aim" && w.size() == 2) {
+                if (w[1] == "player") {
+                    out.ops.push_back(PatternOp{OP_AIM_PLAYER, 0, 0, 0});
+                } else if (number(1, a)) {
+                    out.ops.push_back(PatternOp{OP_HEADING, 0, (float)(a * DEG), 0});
+                } else {
+                    return fail("aim takes player or an angle");
+                }
+            } else if (op == "ring" && number(1, a) && a >= 1) {
+                out.ops.push_back(PatternOp{OP_RING, (int)a, 0, 0});
+            } else if (op == "fan" && number(1, a) && number(2, b) && a >= 1) {
+                out.ops.push_back(PatternOp{OP_FAN, (int)a, (float)(b * DEG), 0});
+            } else if (op == "wait" && number(1, a) && a >= 0) {
+                out.ops.push_back(PatternOp{OP_WAIT, (int)msToTicks(a), 0, 0});
+            } else if (op == "repeat" && number(1, a) && a >= 1) {
+                if ((int)loops.size() == PATTERN_MAX_DEPTH) return fail("repeat nested too deep");
+                loops.push_back((int)out.ops.size());
+                out.ops.push_back(PatternOp{OP_REPEAT, (int)a, 0, 0});
+            } else {
+                return fail("unknown or malformed instruction");
+            }
+        }
+        if (!pattern.empty() || !wave.empty()) {
+            error = "missing 'end' at end of file";
+            return false;
+        }
+
+        for (size_t i = 0; i < uses.size(); i++) {
+            auto it = out.entry.find(useNames[i]);
+            if (it == out.entry.end()) {
+                error = "wave " + uses[i].first + " uses unknown pattern " + useNames[i];
+                return false;
+            }
+            out.waves[uses[i].first][uses[i].second].pattern = it->second;
+        }
+
+        out.hash = 14695981039346656037ull;
+        auto mix = [&](Uint64 v) { out.hash = (out.hash ^ v) * 1099511628211ull; };
+        for (auto& op : out.ops) {
+            Uint32 a32, b32;
+            memcpy(&a32, &op.a, 4);
+            memcpy(&b32, &op.b, 4);
+            mix(op.code);
+            mix((Uint32)op.n);
+            mix(a32);
+            mix(b32);
+        }
+        for (auto& wave : out.waves) {
+            for (char c : wave.first) mix((Uint8)c);
+            for (auto& e : wave.second) {
+                mix((Uint32)e.pattern);
+                mix(e.start);
+                mix(e.period);
+                mix(e.until);
+                mix(e.origin);
+                mix((Uint64)(Sint64)e.x);
+                mix((Uint64)(Sint64)e.y);
+            }
+        }
+        *this = out;
+        return true;
+    }
+};
+
+PatternSet patterns;
+
+// One running pattern. Plain data, so thousands of them sit in one vector
+// and a finished one is dropped by swapping in the last.
+struct Emitter {
+    int pc;
+    Uint32 wait; // ticks left before pc runs again
+    float x, y;
+    float heading; // radians
+    float speedMin, speedMax, accel, turn;
+    int sprite; // -1 picks by side
+    int side;
+    int depth;
+    int loopLeft[PATTERN_MAX_DEPTH];
+};
+
+Emitter makeEmitter(const WaveEntry& e, Rng& rng) {
+    Emitter em = {};
+    em.pc = e.pattern;
+    em.speedMin = em.speedMax = 300;
+    em.sprite = -1;
+    if (e.origin == ORIGIN_EDGE) {
+        int x, y;
+        em.side = randomEdgePoint(rng, x, y);
+        em.x = x;
+        em.y = y;
+        return em;
+    }
+    if (e.origin == ORIGIN_RANDOM) {
+        em.x = rng.range(SCREEN_WIDTH);
+        em.y = rng.range(SCREEN_HEIGHT);
+    } else if (e.origin == ORIGIN_CENTER) {
+        em.x = SCREEN_WIDTH / 2;
+        em.y = SCREEN_HEIGHT / 2;
+    } else {
+        em.x = e.x;
+        em.y = e.y;
+    }
+    // Inside the field the nearest edge stands in for the side.
+    float d[4] = {SCREEN_HEIGHT - em.y, em.x, em.y, SCREEN_WIDTH - em.x};
+    em.side = (int)(min_element(d, d + 4) - d);
+    return em;
+}
+
+// The first tick after `after` on which e starts an emitter, or 0 if it never
+// does again.
+Uint32 nextWaveTick(const WaveEntry& e, Uint32 after) {
+    Uint32 t = e.start;
+    if (e.period && t <= after) t += ((after - t) / e.period + 1) * e.period;
+    if (t <= after || (e.until && t >= e.until)) return 0;
+    return t;
+}
+
+// Advances every emitter by one tick: each runs its ops until it waits or
+// ends, or hits PATTERN_MAX_OPS_PER_TICK, which stops a repeat without a wait
+// from stalling the step.
+void runEmitters(vector<Emitter>& emitters, const PatternSet& set, BulletPool& bullets, Rng& rng, int playerX, int playerY) {
+    const PatternOp* ops = set.ops.data();
+    for (size_t k = 0; k < emitters.size();) {
+        Emitter& em = emitters[k];
+        if (em.wait > 0) {
+            em.wait--;
+            k++;
+            continue;
+        }
+        bool done = false;
+        for (int budget = PATTERN_MAX_OPS_PER_TICK; budget > 0 && !done && em.wait == 0; budget--) {
+            const PatternOp& op = ops[em.pc++];
+            switch (op.code) {
+                case OP_END: done = true; break;
+                case OP_SPRITE: em.sprite = op.n; break;
+                case OP_SPEED: em.speedMin = op.a; em.speedMax = op.b; break;
+                case OP_ACCEL: em.accel = op.a; break;
+                case OP_TURN: em.turn = op.a; break;
+                case OP_AIM_PLAYER: em.heading = atan2(playerY - em.y, playerX - em.x); break;
+                case OP_HEADING: em.heading = op.a; break;
+                case OP_ROTATE: em.heading += op.a; break;
+                case OP_RING:
+                case OP_FAN: {
+                    float first = em.heading, stepAngle = 0;
+                    if (op.code == OP_RING) {
+                        stepAngle = 6.2831853f / op.n;
+                    } else if (op.n > 1) {
+                        first -= op.a / 2;
+                        stepAngle = op.a / (op.n - 1);
+                    }
+                    int tex = em.sprite < 0 ? em.side : em.sprite;
+                    for (int i = 0; i < op.n; i++) {
+                        if (bullets.count == bullets.capacity && !bullets.grow()) break;
+                        float angle = first + stepAngle * i;
+                        float speed = em.speedMin + rng.range((int)(em.speedMax - em.speedMin) + 1);
+                        bullets.spawn(em.x, em.y, cos(angle) * speed, sin(angle) * speed, tex, em.accel, em.turn);
+                    }
+                    break;
+                }
+                case OP_WAIT: em.wait = op.n; break;
+                case OP_REPEAT: em.loopLeft[em.depth++] = op.n; break;
+                case OP_LOOP:
+                    if (--em.loopLeft[em.depth - 1] > 0) {
+                        em.pc = op.n + 1;
+                    } else {
+                        em.depth--;
+                    }
+                    break;
+            }
+        }
+        // A wait of n ticks resumes on the nth tick after this one.
+        if (em.wait > 0) em.wait--;
+        if (done) {
+            em = emitters.back();
+            emitters.pop_back();
+        } else {
+            k++;
+        }
+    }
+}
+
+// Hierarchical timer wheel on the simulation clock. Level 0 has a slot per
+// tick for the next TIMER_WHEEL_SLOTS ticks; each level above covers
+// TIMER_WHEEL_SLOTS times the span of the one below, and its slots spill
+// into the level below as the clock reaches them. Scheduling and cancelling
+// are O(1) list splices and advancing costs a slot visit per tick plus one
+// move per level a timer passes through, however many timers are waiting.
+// Timers due on the same tick fire sorted by their order key, then in the
+// order they were scheduled, so runs replay exactly. The wheel only moves
+// when advance() is called with a later tick: a paused simulation holds it
+// still and a coarse step runs it forward in one call.
+const int TIMER_WHEEL_BITS = 6;
+const int TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS;
+const int TIMER_WHEEL_LEVELS = 4; // 2^24 ticks, about 39 hours; later timers go round the top level again
+
+struct TimerEvent {
+    Uint32 due, order, data;
+};
+
+struct TimerWheel {
+    struct Timer {
+        Uint32 due, order, data;
+        Uint32 seq;
+        int prev, next; // within a slot list, or the free list through next
+        int slot;       // -1 when free
+    };
+
+    Uint32 now = 0;
+    Uint32 seq = 0;
+    int live = 0;
+    int freeList = -1;
+    vector<Timer> timers;
+    vector<int> due; // scratch
+    int heads[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+
+    TimerWheel() {
+        clear(0);
+    }
+
+    // Drops every timer and sets the clock; storage is kept.
+    void clear(Uint32 tick) {
+        now = tick;
+        live = 0;
+        freeList = -1;
+        timers.clear();
+        fill(heads, heads + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, -1);
+    }
+
+    void link(int h) {
+        Timer& t = timers[h];
+        Uint32 delta = t.due - now;
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= 1u << (TIMER_WHEEL_BITS * (level + 1))) level++;
+        int slot = level * TIMER_WHEEL_SLOTS + ((t.due >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+        if (level == TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) {
+            // Past the top level's span: park it where it comes up last.
+            slot = level * TIMER_WHEEL_SLOTS + (((now >> (TIMER_WHEEL_BITS * level)) - 1) & (TIMER_WHEEL_SLOTS - 1));
+        }
+        t.slot = slot;
+        t.prev = -1;
+        t.next = heads[slot];
+        if (t.next >= 0) timers[t.next].prev = h;
+        heads[slot] = h;
+    }
+
+    void unlink(int h) {
+        Timer& t = timers[h];
+        if (t.prev >= 0) {
+            timers[t.prev].next = t.next;
+        } else {
+            heads[t.slot] = t.next;
+        }
+        if (t.next >= 0) timers[t.next].prev = t.prev;
+    }
+
+    // Fires on tick `at`, at the earliest the tick after now. Returns a handle
+    // that stays good until the timer fires or is cancelled.
+    int schedule(Uint32 at, Uint32 order, Uint32 data) {
+        int h = freeList;
+        if (h >= 0) {
+            freeList = timers[h].next;
+        } else {
+            h = (int)timers.size();
+            timers.push_back(Timer());
+        }
+        Timer& t = timers[h];
+        t.due = (Sint32)(at - now) > 0 ? at : now + 1;
+        t.order = order;
+        t.data = data;
+        t.seq = seq++;
+        link(h);
+        live++;
+        return h;
+    }
+
+    void release(int h) {
+        timers[h].slot = -1;
+        timers[h].next = freeList;
+        freeList = h;
+        live--;
+    }
+
+    void cancel(int h) {
+        unlink(h);
+        release(h);
+    }
+
+    // Changes what a pending timer hands back when it fires.
+    void retarget(int h, Uint32 data) {
+        timers[h].data = data;
+    }
+
+    // Moves the clock to tick and appends every timer due by then to out,
+    // earliest first.
+    void advance(Uint32 tick, vector<TimerEvent>& out) {
+        if (live == 0) {
+            now = tick;
+            return;
+        }
+        due.clear();
+        while (now != tick) {
+            now++;
+            // Whenever the low bits roll over, the next level's slot for the
+            // new block comes down a level (or straight to level 0).
+            for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+                if (now & ((1u << (TIMER_WHEEL_BITS * level)) - 1)) break;
+                int slot = level * TIMER_WHEEL_SLOTS + ((now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+                int h = heads[slot];
+                heads[slot] = -1;
+                while (h >= 0) {
+                    int next = timers[h].next;
+                    link(h);
+                    h = next;
+                }
+            }
+            int slot = now & (TIMER_WHEEL_SLOTS - 1);
+            for (int h = heads[slot]; h >= 0; h = timers[h].next) due.push_back(h);
+            heads[slot] = -1;
+        }
+        sort(due.begin(), due.end(), [this](int a, int b) {
+            const Timer& x = timers[a];
+            const Timer& y = timers[b];
+            if (x.due != y.due) return (Sint32)(x.due - y.due) < 0;
+            if (x.order != y.order) return x.order < y.order;
+            return (Sint32)(x.seq - y.seq) < 0;
+        });
+        for (int h : due) {
+            out.push_back(TimerEvent{timers[h].due, timers[h].order, timers[h].data});
+            release(h);
+        }
+    }
+};
+
+// What a Game's timers stand for; the kind is the top byte of the order key.
+enum TimerKind {
+    TIMER_WAVE, TIMER_SHIELD
+};
+
+const int PLAYER_START_X = SCREEN_WIDTH / 2 - 30;
+const int PLAYER_START_Y = SCREEN_HEIGHT / 2 - 30;
+
+// Room reserved up front so a running game does not allocate for these.
+const int GAME_RESERVE_SHIELDS = 16;
+const int GAME_RESERVE_EMITTERS = 64;
+
+// Where something worth showing happened during a step: a bullet stopped by
+// a shield or by the player, or the game ending. The simulation only records
+// these, up to IMPACT_BUDGET until someone takes them, and never reads them.
+enum ImpactKind {
+    IMPACT_BLOCK, IMPACT_HIT, IMPACT_OVER, IMPACT_KINDS
+};
+
+const int IMPACT_BUDGET = 512;
+
+struct Impact {
+    float x, y;
+    ImpactKind kind;
+};
+
+// Everything a single play session needs to advance. It never reads the wall
+// clock or touches SDL video/audio, so it can run without a window.
+struct Game {
+    GameMode mode = MODE_CLASSIC;
+    Player player;
+    BulletPool bullets;
+    BulletPool spare{0}; // compaction target in bullet hell, swapped with bullets
+    vector<Shield> shields;
+    SpatialGrid grid;
+    vector<int> hits;
+    vector<Uint8> hitMask;
+    vector<int> hitTick;    // the sub-tick of each HIT_PLAYER in hitMask
+    vector<int> chunkLive, chunkHits, tickHits;
+    vector<Player> path;    // the player after each sub-tick of this step, from 0
+    SDL_Rect playerReach;   // everything path covers, with some slack
+    vector<int> spawnFrom;  // bullets.count before each sub-tick's spawns
+    vector<Emitter> emitters;
+    const vector<WaveEntry>* wave = nullptr; // classic mode's schedule in patterns
+    TimerWheel timers;                       // wave entries and shield expiries
+    vector<TimerEvent> fired;
+    int expiring = 0;                        // shields marked expired this step
+    vector<Impact> impacts;                  // for effects; cleared by whoever takes them
+    Rng rng;
+    Uint32 tick = 0;
+    Uint32 lastWall = 0;
+    bool firstShieldUsed = false;
+    int targetX = 0, targetY = 0;
+    int health = 0;
+    bool invulnerable = false; // headless throughput runs keep going at any density
+    bool over = false;
+
+    // Simulation time in milliseconds.
+    Uint32 now() const {
+        return (Uint32)((Uint64)tick * 1000 / SIM_HZ);
+    }
+
+    int survivalTime() const {
+        return now() / 1000;
+    }
+
+    int remainingCooldown() const {
+        if (!firstShieldUsed || now() - lastWall > WALL_COOLDOWN_MS) return 0;
+        return (WALL_COOLDOWN_MS - (now() - lastWall)) / 1000;
+    }
+
+    void reset(Uint64 seed, GameMode m = MODE_CLASSIC) {
+        mode = m;
+        bullets.clear();
+        bullets.setCapacity(mode == MODE_BULLET_HELL ? HELL_CHUNK : BULLET_CAPACITY);
+        shields.clear();
+        emitters.clear();
+        impacts.clear();
+        shields.reserve(GAME_RESERVE_SHIELDS);
+        emitters.reserve(GAME_RESERVE_EMITTERS);
+        impacts.reserve(IMPACT_BUDGET);
+        fitScratch();
+        auto classic = patterns.waves.find("classic");
+        wave = classic != patterns.waves.end() ? &classic->second : nullptr;
+        rng.reseed(seed);
+        player.rect = {PLAYER_START_X, PLAYER_START_Y, 60, 60};
+        player.placeAt(player.rect.x, player.rect.y);
+        player.facingRight = true;
+        playerReach = grownRect(player.rect, 2);
+        tick = 0;
+        lastWall = 0;
+        firstShieldUsed = false;
+        targetX = player.rect.x;
+        targetY = player.rect.y;
+        health = mode == MODE_BULLET_HELL ? HELL_HEALTH : 1;
+        over = false;
+        restartTimers();
+    }
+
+    // Rebuilds the timers from the state: each wave entry's next start and
+    // each shield's expiry.
+    void restartTimers() {
+        timers.clear(tick);
+        fired.reserve(GAME_RESERVE_EMITTERS);
+        expiring = 0;
+        if (wave && mode == MODE_CLASSIC) {
+            for (size_t i = 0; i < wave->size(); i++) scheduleWaveEntry((int)i, tick);
+        }
+        for (size_t i = 0; i < shields.size(); i++) {
+            shields[i].expired = false;
+            shields[i].timer = timers.schedule(shields[i].expiryTick(), TIMER_SHIELD << 24, (Uint32)i);
+        }
+    }
+
+    void scheduleWaveEntry(int i, Uint32 after) {
+        Uint32 t = nextWaveTick((*wave)[i], after);
+        if (t) timers.schedule(t, TIMER_WAVE << 24 | i, i);
+    }
+
+    // Runs the timers due by tick t. Wave entries start their emitters at
+    // once; shields are only marked, so they still block the rest of this
+    // step and go in expireShields().
+    void runTimers(Uint32 t) {
+        fired.clear();
+        timers.advance(t, fired);
+        for (const TimerEvent& e : fired) {
+            if (e.order >> 24 == TIMER_WAVE) {
+                emitters.push_back(makeEmitter((*wave)[e.data], rng));
+                scheduleWaveEntry(e.data, e.due);
+            } else {
+                shields[e.data].expired = true;
+                expiring++;
+            }
+        }
+    }
+
+    void addImpact(float x, float y, ImpactKind kind) {
+        if (impacts.size() < (size_t)IMPACT_BUDGET) impacts.push_back(Impact{x, y, kind});
+    }
+
+    void addBulletImpact(int i, Uint8 mask) {
+        addImpact(bullets.x[i] + BULLET_SIZE / 2, bullets.y[i] + BULLET_SIZE / 2, (mask & HIT_SHIELD) ? IMPACT_BLOCK : IMPACT_HIT);
+    }
+
+    void addShield(const Shield& shield) {
+        shields.push_back(shield);
+        shields.back().timer = timers.schedule(shield.expiryTick(), TIMER_SHIELD << 24, (Uint32)(shields.size() - 1));
+    }
+
+    // Sizes the per-step buffers for the pool's current capacity, so they only
+    // allocate on the step the pool itself grows.
+    void fitScratch() {
+        hitMask.reserve(bullets.capacity);
+        hitTick.reserve(bullets.capacity);
+        if (mode != MODE_BULLET_HELL) return;
+        int chunks = (bullets.capacity + HELL_CHUNK - 1) / HELL_CHUNK;
+        chunkLive.reserve(chunks);
+        chunkHits.reserve(chunks);
+        if (spare.capacity < bullets.capacity) spare.setCapacity(bullets.capacity);
+    }
+
+    void setTarget(int x, int y) {
+        targetX = x;
+        targetY = y;
+        player.facingRight = targetX > player.rect.x + player.rect.w / 2;
+    }
+
+    // Drops a shield across the direction from the player to (aimX, aimY).
+    bool placeShield(int aimX, int aimY) {
+        if (firstShieldUsed && now() - lastWall <= WALL_COOLDOWN_MS) return false;
+
+        int playerCenterX = player.rect.x + player.rect.w / 2;
+        int playerCenterY = player.rect.y + player.rect.h / 2;
+
+        float dx = aimX - playerCenterX;
+        float dy = aimY - playerCenterY;
+        bool isHorizontalShield = abs(dx) < abs(dy);
+
+        addShield(Shield(playerCenterX, playerCenterY, isHorizontalShield, now()));
+        lastWall = now();
+        firstShieldUsed = true;
+        return true;
+    }
+
+    // Moves the player through the step one tick at a time. path keeps where
+    // it stood after each tick (path[0] is the start) and playerReach the
+    // ground it covered, grown to take in the fractions its rects drop.
+    void tracePlayer(int ticks) {
+        path.resize(ticks + 1);
+        path[0] = player;
+        SDL_Rect& r = playerReach;
+        r = player.rect;
+        for (int j = 1; j <= ticks; j++) {
+            player.moveTo(targetX, targetY, SIM_DT);
+            path[j] = player;
+            const SDL_Rect& p = player.rect;
+            int right = max(r.x + r.w, p.x + p.w), bottom = max(r.y + r.h, p.y + p.h);
+            r.x = min(r.x, p.x);
+            r.y = min(r.y, p.y);
+            r.w = right - r.x;
+            r.h = bottom - r.y;
+        }
+        player.prevX = path[0].x;
+        player.prevY = path[0].y;
+        r = grownRect(r, 2);
+    }
+
+    // Moves bullets [begin, end) for the ticks of this step each was there
+    // for: those spawned on sub-tick j move from j on, as they would have.
+    void moveSpawned(int begin, int end, int ticks) {
+        for (int j = 1; j <= ticks; j++) {
+            int lo = max(begin, j == 1 ? 0 : spawnFrom[j]), hi = min(end, spawnFrom[j + 1]);
+            if (lo < hi) bullets.move(SIM_DT, lo, hi, ticks - j + 1);
+        }
+    }
+
+    // Sweeps bullets [begin, end) from prev to their current position
+    // against every shield and against all the ground the player covered,
+    // each grown a little. Only a first cut for resolveHits().
+    void sweepBullets(int begin, int end, Uint8* mask) {
+        const BulletPool& b = bullets;
+        for (auto& shield : shields) {
+            collideBatch(&b.prevX[begin], &b.prevY[begin], &b.x[begin], &b.y[begin], end - begin, BULLET_SIZE,
+                         grownRect(shield.rect, 1), 0, 0, mask, HIT_SHIELD);
+        }
+        collideBatch(&b.prevX[begin], &b.prevY[begin], &b.x[begin], &b.y[begin], end - begin, BULLET_SIZE,
+                     playerReach, 0, 0, mask, HIT_PLAYER);
+    }
+
+    // Sets HIT_SHIELD / HIT_PLAYER in hitMask for every bullet that may have
+    // touched a shield or the player during the last move.
+    void markHits() {
+        // A handful of shields is cheapest to test as whole batches; past that
+        // each bullet asks the grid which shields are near the area it swept.
+        hitMask.assign(bullets.count, 0);
+        if (bullets.count == 0) return;
+        if (shields.size() <= BROADPHASE_MIN_SHIELDS) {
+            sweepBullets(0, bullets.count, hitMask.data());
+            return;
+        }
+        grid.clear();
+        for (auto& shield : shields) grid.add(shield.rect);
+        grid.build();
+        for (int i = 0; i < bullets.count; i++) {
+            hits.clear();
+            grid.queryAABB(grownRect(bullets.sweptRect(i), 1), hits);
+            for (int id : hits) {
+                collideBatchScalar(&bullets.prevX[i], &bullets.prevY[i], &bullets.x[i], &bullets.y[i], 1, BULLET_SIZE,
+                                   grownRect(shields[id].rect, 1), 0, 0, &hitMask[i], HIT_SHIELD);
+            }
+        }
+        collideBatch(bullets.prevX.data(), bullets.prevY.data(), bullets.x.data(), bullets.y.data(), bullets.count, BULLET_SIZE,
+                     playerReach, 0, 0, hitMask.data(), HIT_PLAYER);
+    }
+
+    // Plays bullet i through sub-ticks from..ticks of this step one tick at a
+    // time, exactly as single steps would: each tick is swept against the
+    // shields still up on it and against the player's move on it, and within
+    // a tick a shield or the edge of the field comes before the player. Stops
+    // on the tick something stops the bullet and returns what did; a player
+    // hit's sub-tick goes in hitTick.
+    Uint8 playThrough(int i, int from, int ticks) {
+        BulletPool& b = bullets;
+        Uint32 base = tick - ticks;
+        b.prevX[i] = b.x[i];
+        b.prevY[i] = b.y[i];
+        for (int j = from; j <= ticks; j++) {
+            float sx = b.x[i], sy = b.y[i];
+            b.advance(i, SIM_DT);
+            Uint8 m = 0;
+            for (size_t s = 0; s < shields.size() && !m; s++) {
+                if (base + j > shields[s].expiryTick()) continue;
+                collideBatchScalar(&sx, &sy, &b.x[i], &b.y[i], 1, BULLET_SIZE, shields[s].rect, 0, 0, &m, HIT_SHIELD);
+            }
+            if (m) return m;
+            if (b.offscreen(i)) return HIT_GONE;
+            const Player& p = path[j];
+            collideBatchScalar(&sx, &sy, &b.x[i], &b.y[i], 1, BULLET_SIZE, p.rect, p.x - path[j - 1].x,
+                               p.y - path[j - 1].y, &m, HIT_PLAYER);
+            if (m) {
+                hitTick[i] = j;
+                return m;
+            }
+        }
+        return 0;
+    }
+
+    // Settles bullets [begin, end) of a straight pool after the first cut in
+    // hitMask. Those it caught, and any that started off the field, are wound
+    // back and played through; the rest only need culling. Leaves HIT_SHIELD,
+    // HIT_PLAYER or HIT_GONE for whatever stopped each bullet, 0 otherwise.
+    void resolveHits(int begin, int end, int ticks) {
+        BulletPool& b = bullets;
+        int from = 1;
+        for (int i = begin; i < end; i++) {
+            while (from < ticks && i >= spawnFrom[from + 1]) from++;
+            Uint8& m = hitMask[i];
+            if (m || BulletPool::outside(b.prevX[i], b.prevY[i])) {
+                b.x[i] = b.prevX[i];
+                b.y[i] = b.prevY[i];
+                m = playThrough(i, from, ticks);
+            } else if (b.offscreen(i)) {
+                m = HIT_GONE;
+            }
+        }
+    }
+
+    // Whether bullet i could reach a shield, the player or the edge of the
+    // field within ticks moves. Turning keeps its speed and acceleration can
+    // add at most the acceleration each tick, which bounds how far it goes.
+    bool mayStop(int i, int ticks) const {
+        const BulletPool& b = bullets;
+        float t = SIM_DT * ticks;
+        float speed = sqrt(b.vx[i] * b.vx[i] + b.vy[i] * b.vy[i]);
+        float accel = sqrt(b.ax[i] * b.ax[i] + b.ay[i] * b.ay[i]);
+        float reach = t * (speed + accel * t) + 2;
+        SDL_Rect box = {(int)floor(b.x[i] - reach), (int)floor(b.y[i] - reach), 0, 0};
+        box.w = box.h = (int)ceil(2 * reach) + BULLET_SIZE + 2;
+        if (box.x < -CULL_MARGIN || box.y < -CULL_MARGIN || box.x + box.w > SCREEN_WIDTH + CULL_MARGIN ||
+            box.y + box.h > SCREEN_HEIGHT + CULL_MARGIN) {
+            return true;
+        }
+        if (checkCollision(box, playerReach)) return true;
+        for (auto& shield : shields) {
+            if (checkCollision(box, shield.rect)) return true;
+        }
+        return false;
+    }
+
+    // Ends the game on sub-tick j of a ticks-tick step, with the player
+    // where it stood then.
+    void endOn(int j, int ticks) {
+        tick -= ticks - j;
+        player = path[j];
+        over = true;
+        addImpact(player.x + player.rect.w / 2, player.y + player.rect.h / 2, IMPACT_OVER);
+    }
+
+    // Drops the shields whose timers have fired, keeping the rest in order.
+    void expireShields() {
+        if (!expiring) return;
+        size_t kept = 0;
+        for (size_t i = 0; i < shields.size(); i++) {
+            if (shields[i].expired) continue;
+            if (kept != i) {
+                shields[kept] = shields[i];
+                timers.retarget(shields[kept].timer, (Uint32)kept);
+            }
+            kept++;
+        }
+        shields.erase(shields.begin() + kept, shields.end());
+        expiring = 0;
+    }
+
+    // Advances the simulation by ticks ticks, ending exactly where as many
+    // single steps with the same inputs would. The player and spawning go
+    // tick by tick. Bullets move in bulk and one sweep over the whole span
+    // picks out those near a shield, the player or the edge; only they are
+    // played through tick by tick, so a shield still blocks only until the
+    // tick it expires and whichever of a shield and the player a bullet
+    // reaches first takes it. A hit ends the game on the tick it lands.
+    void step(int ticks = 1) {
+        if (over) return;
+        tick += ticks;
+
+        PROFILE_BEGIN(playerScope, PHASE_PLAYER);
+        tracePlayer(ticks);
+        PROFILE_END(playerScope);
+
+        PROFILE_BEGIN(spawnScope, PHASE_SPAWN);
+        spawnFrom.resize(ticks + 2);
+        for (int j = 1; j <= ticks; j++) {
+            const SDL_Rect& aim = path[j].rect;
+            spawnFrom[j] = bullets.count;
+            runTimers(tick - ticks + j);
+            if (mode != MODE_BULLET_HELL) {
+                runEmitters(emitters, patterns, bullets, rng, aim.x, aim.y);
+                continue;
+            }
+            int spawns = hellSpawnsPerTick(tick - ticks + j);
+            for (int i = 0; i < spawns; i++) {
+                if (bullets.count == bullets.capacity && !bullets.grow()) break;
+                spawnHellBullet(bullets, aim.x, aim.y, rng);
+            }
+        }
+        spawnFrom[ticks + 1] = bullets.count;
+        fitScratch();
+        hitTick.resize(bullets.count);
+        PROFILE_END(spawnScope);
+
+        if (mode == MODE_BULLET_HELL) {
+            stepHell(ticks);
+            return;
+        }
+
+        int count = bullets.count;
+        if (bullets.straight) {
+            PROFILE_BEGIN(bulletsScope, PHASE_BULLETS);
+            moveSpawned(0, count, ticks);
+            PROFILE_END(bulletsScope);
+            PROFILE_SCOPE(PHASE_COLLISION);
+            markHits();
+            resolveHits(0, count, ticks);
+        } else {
+            // Curving paths leave the span's sweep, so each bullet is checked
+            // against how far it could get instead.
+            PROFILE_SCOPE(PHASE_BULLETS);
+            hitMask.resize(count);
+            int from = 1;
+            for (int i = 0; i < count; i++) {
+                while (from < ticks && i >= spawnFrom[from + 1]) from++;
+                if (mayStop(i, ticks - from + 1)) {
+                    hitMask[i] = playThrough(i, from, ticks);
+                } else {
+                    bullets.move(SIM_DT, i, i + 1, ticks - from + 1);
+                    hitMask[i] = 0;
+                }
+            }
+        }
+
+        PROFILE_BEGIN(collisionScope, PHASE_COLLISION);
+        int overAt = 0;
+        for (int i = 0; i < bullets.count;) {
+            Uint8 m = hitMask[i];
+            if (m) {
+                if (m & HIT_PLAYER) overAt = overAt ? min(overAt, hitTick[i]) : hitTick[i];
+                if (m != HIT_GONE) addBulletImpact(i, m);
+                hitMask[i] = hitMask[bullets.count - 1];
+                hitTick[i] = hitTick[bullets.count - 1];
+                bullets.remove(i);
+            } else {
+                i++;
+            }
+        }
+        if (overAt) endOn(overAt, ticks);
+        PROFILE_END(collisionScope);
+
+        PROFILE_SCOPE(PHASE_SHIELDS);
+        expireShields();
+    }
+
+    // The bullet-hell step, after step() has moved the player and spawned.
+    // One parallel pass moves, tests and culls each chunk and counts its
+    // survivors and player hits; the counts are summed in chunk order and a
+    // second pass copies survivors into spare at their chunk's offset.
+    // Chunking depends only on the bullet count, never on the number of
+    // threads, so every thread count gives the same result.
+    void stepHell(int ticks) {
+        int count = bullets.count;
+        int chunks = (count + HELL_CHUNK - 1) / HELL_CHUNK;
+        hitMask.resize(count);
+        chunkLive.assign(chunks, 0);
+        chunkHits.assign(chunks, 0);
+
+        PROFILE_BEGIN(bulletsScope, PHASE_BULLETS);
+        jobs.parallelFor(chunks, [this, count, ticks](int c) {
+            int begin = c * HELL_CHUNK;
+            int end = min(count, begin + HELL_CHUNK);
+            Uint8* mask = hitMask.data() + begin;
+            moveSpawned(begin, end, ticks);
+            memset(mask, 0, end - begin);
+            sweepBullets(begin, end, mask);
+            resolveHits(begin, end, ticks);
+
+            int live = 0, hit = 0;
+            for (int i = begin; i < end; i++) {
+                Uint8& m = hitMask[i];
+                if (m & HIT_PLAYER) hit++;
+                if (m) m |= HIT_GONE;
+                live += !m;
+            }
+            chunkLive[c] = live;
+            chunkHits[c] = hit;
+        });
+        PROFILE_END(bulletsScope);
+
+        PROFILE_BEGIN(collisionScope, PHASE_COLLISION);
+        int survivors = 0, playerHits = 0;
+        for (int c = 0; c < chunks; c++) {
+            int live = chunkLive[c];
+            chunkLive[c] = survivors;
+            survivors += live;
+            playerHits += chunkHits[c];
+        }
+        // Effects for the bullets stopped this step, while the budget lasts.
+        if (playerHits || !shields.empty()) {
+            for (int i = 0; i < count && impacts.size() < (size_t)IMPACT_BUDGET; i++) {
+                if (hitMask[i] & (HIT_SHIELD | HIT_PLAYER)) addBulletImpact(i, hitMask[i]);
+            }
+        }
+        jobs.parallelFor(chunks, [this, count](int c) {
+            int begin = c * HELL_CHUNK;
+            int end = min(count, begin + HELL_CHUNK);
+            for (int i = begin, out = chunkLive[c]; i < end; i++) {
+                if (!hitMask[i]) spare.copyFrom(bullets, i, out++);
+            }
+        });
+        spare.count = survivors;
+        spare.straight = bullets.straight;
+        spare.nextId = bullets.nextId;
+        swap(bullets, spare);
+        PROFILE_END(collisionScope);
+
+        if (health > playerHits || invulnerable) {
+            health -= playerHits;
+        } else {
+            // The game ends on the sub-tick the last of the health went.
+            tickHits.assign(ticks + 1, 0);
+            for (int i = 0; i < count; i++) {
+                if (hitMask[i] & HIT_PLAYER) tickHits[hitTick[i]]++;
+            }
+            int j = 0;
+            while (health > 0) health -= tickHits[++j];
+            endOn(j, ticks);
+        }
+
+        PROFILE_SCOPE(PHASE_SHIELDS);
+        expireShields();
+    }
+};
+
+const int IMAGE_MAX_BULLETS = 512;
+const int IMAGE_MAX_SHIELDS = 16;
+const int IMAGE_MAX_EMITTERS = 64;
+
+// A classic-mode Game packed into one fixed-size block of plain data, so a
+// copy is a single memcpy with no allocation. pack() fails when the game
+// holds more than fits, as bullet hell always does. unpack() refills an
+// existing Game, reusing its storage, and leaves its scratch buffers alone.
+struct GameImage {
+    Player player;
+    Rng rng;
+    Uint32 tick, lastWall;
+    int targetX, targetY, health;
+    GameMode mode;
+    bool firstShieldUsed, over, straight;
+    int bulletCount, shieldCount, emitterCount;
+    float x[IMAGE_MAX_BULLETS], y[IMAGE_MAX_BULLETS];
+    float prevX[IMAGE_MAX_BULLETS], prevY[IMAGE_MAX_BULLETS];
+    float vx[IMAGE_MAX_BULLETS], vy[IMAGE_MAX_BULLETS];
+    float ax[IMAGE_MAX_BULLETS], ay[IMAGE_MAX_BULLETS];
+    float turnCos[IMAGE_MAX_BULLETS], turnSin[IMAGE_MAX_BULLETS];
+    Uint8 texIndex[IMAGE_MAX_BULLETS];
+    Uint32 id[IMAGE_MAX_BULLETS];
+    Uint32 nextId;
+    SDL_Rect shieldRect[IMAGE_MAX_SHIELDS];
+    Uint32 shieldSpawn[IMAGE_MAX_SHIELDS];
+    Emitter emitters[IMAGE_MAX_EMITTERS];
+
+    bool pack(const Game& game) {
+        const BulletPool& b = game.bullets;
+        if (b.count > IMAGE_MAX_BULLETS || game.shields.size() > (size_t)IMAGE_MAX_SHIELDS ||
+            game.emitters.size() > (size_t)IMAGE_MAX_EMITTERS) {
+            return false;
+        }
+        player = game.player;
+        rng = game.rng;
+        tick = game.tick;
+        lastWall = game.lastWall;
+        targetX = game.targetX;
+        targetY = game.targetY;
+        health = game.health;
+        mode = game.mode;
+        firstShieldUsed = game.firstShieldUsed;
+        over = game.over;
+        straight = b.straight;
+        bulletCount = b.count;
+        int n = b.count;
+        copy_n(b.x.begin(), n, x);
+        copy_n(b.y.begin(), n, y);
+        copy_n(b.prevX.begin(), n, prevX);
+        copy_n(b.prevY.begin(), n, prevY);
+        copy_n(b.vx.begin(), n, vx);
+        copy_n(b.vy.begin(), n, vy);
+        copy_n(b.ax.begin(), n, ax);
+        copy_n(b.ay.begin(), n, ay);
+        copy_n(b.turnCos.begin(), n, turnCos);
+        copy_n(b.turnSin.begin(), n, turnSin);
+        copy_n(b.texIndex.begin(), n, texIndex);
+        copy_n(b.id.begin(), n, id);
+        nextId = b.nextId;
+        shieldCount = (int)game.shields.size();
+        for (int i = 0; i < shieldCount; i++) {
+            shieldRect[i] = game.shields[i].rect;
+            shieldSpawn[i] = game.shields[i].spawnTime;
+        }
+        emitterCount = (int)game.emitters.size();
+        copy_n(game.emitters.begin(), emitterCount, emitters);
+        return true;
+    }
+
+    void unpack(Game& game) const {
+        BulletPool& b = game.bullets;
+        if (b.capacity < IMAGE_MAX_BULLETS) b.setCapacity(IMAGE_MAX_BULLETS);
+        game.player = player;
+        game.rng = rng;
+        game.tick = tick;
+        game.lastWall = lastWall;
+        game.targetX = targetX;
+        game.targetY = targetY;
+        game.health = health;
+        game.mode = mode;
+        game.firstShieldUsed = firstShieldUsed;
+        game.over = over;
+        auto classic = patterns.waves.find("classic");
+        game.wave = classic != patterns.waves.end() ? &classic->second : nullptr;
+        b.straight = straight;
+        b.count = bulletCount;
+        int n = bulletCount;
+        copy_n(x, n, b.x.begin());
+        copy_n(y, n, b.y.begin());
+        copy_n(prevX, n, b.prevX.begin());
+        copy_n(prevY, n, b.prevY.begin());
+        copy_n(vx, n, b.vx.begin());
+        copy_n(vy, n, b.vy.begin());
+        copy_n(ax, n, b.ax.begin());
+        copy_n(ay, n, b.ay.begin());
+        copy_n(turnCos, n, b.turnCos.begin());
+        copy_n(turnSin, n, b.turnSin.begin());
+        copy_n(texIndex, n, b.texIndex.begin());
+        copy_n(id, n, b.id.begin());
+        b.nextId = nextId;
+        game.shields.clear();
+        for (int i = 0; i < shieldCount; i++) {
+            game.shields.push_back(Shield(0, 0, false, shieldSpawn[i]));
+            game.shields.back().rect = shieldRect[i];
+        }
+        game.emitters.assign(emitters, emitters + emitterCount);
+        game.impacts.clear();
+        game.restartTimers();
+    }
+};
+
+// What the renderer needs from one simulation step. The simulation thread
+// fills one of these after stepping and hands it over whole; slot storage is
+// reused, so publishing does not allocate once the vectors have grown.
+struct SimSnapshot {
+    Player player;
+    BulletPool bullets{0};
+    vector<Shield> shields;
+    GameMode mode = MODE_CLASSIC;
+    int survivalTime = 0;
+    int remainingCooldown = 0;
+    int health = 0;
+    bool over = false;
+    bool finished = false;  // a replay has run out
+    Uint32 session = 0;     // restarts applied so far
+    Uint32 inputs = 0;      // SIM_INPUT commands taken in so far
+    Uint64 stepCounter = 0; // performance counter when the step finished
+    vector<Impact> impacts; // every impact not yet taken, numbered from impactBase
+    Uint32 impactBase = 0;
+
+    SimSnapshot() {
+        shields.reserve(GAME_RESERVE_SHIELDS);
+        impacts.reserve(IMPACT_BUDGET);
+    }
+
+    void capture(const Game& game) {
+        player = game.player;
+        // Grows with the game's pool rather than with the count, so both
+        // allocate on the same step.
+        if (bullets.capacity < game.bullets.capacity) bullets.setCapacity(game.bullets.capacity);
+        bullets.count = game.bullets.count;
+        int n = bullets.count;
+        copy_n(game.bullets.x.begin(), n, bullets.x.begin());
+        copy_n(game.bullets.y.begin(), n, bullets.y.begin());
+        copy_n(game.bullets.prevX.begin(), n, bullets.prevX.begin());
+        copy_n(game.bullets.prevY.begin(), n, bullets.prevY.begin());
+        copy_n(game.bullets.texIndex.begin(), n, bullets.texIndex.begin());
+        shields = game.shields;
+        mode = game.mode;
+        survivalTime = game.survivalTime();
+        remainingCooldown = game.remainingCooldown();
+        health = game.health;
+        over = game.over;
+    }
+};
+
+// Lock-free triple buffer for one writer and one reader. The writer fills
+// its back slot and swaps it with the middle one; the reader swaps the middle
+// slot into its front only when something new was published. Neither side
+// ever waits, and the reader always sees a whole snapshot.
+template <class T>
+struct TripleBuffer {
+    static const int FRESH = 4;
+
+    T slots[3];
+    atomic<int> middle{1};
+    int back = 0;  // writer only
+    int front = 2; // reader only
+
+    T& writeSlot() {
+        return slots[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, memory_order_acq_rel) & 3;
+    }
+
+    // Picks up the newest published slot; returns false if nothing changed.
+    bool update() {
+        if (!(middle.load(memory_order_relaxed) & FRESH)) return false;
+        front = middle.exchange(front, memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    const T& readSlot() const {
+        return slots[front];
+    }
+};
+
+#ifdef GAME_PROFILER
+// F3 overlay: min/avg/p99 per phase plus a graph of recent frame times
+// against the 60 FPS budget.
+void renderProfilerOverlay(SDL_Renderer* renderer, TTF_Font* font) {
+    const int x = SCREEN_WIDTH - 430, y = 10, w = 420, lineHeight = 26;
+    const int graphHeight = 80;
+    int h = (PHASE_COUNT + 3) * lineHeight + graphHeight + 20;
+    SDL_Rect panel = {x, y, w, h};
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 190);
+    SDL_RenderFillRect(renderer, &panel);
+    renderStats.draw(nullptr);
+
+    char line[96];
+    float lo, avg, p99;
+    SDL_Color gold = {255, 215, 0};
+    renderText(renderer, font, "phase      min    avg    p99 ms", x + 10, y + 5, gold);
+    profiler.stats(PHASE_COUNT, lo, avg, p99);
+    snprintf(line, sizeof(line), "%-9s %6.2f %6.2f %6.2f", "frame", lo, avg, p99);
+    renderText(renderer, font, line, x + 10, y + 5 + lineHeight);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        profiler.stats(p, lo, avg, p99);
+        snprintf(line, sizeof(line), "%-9s %6.2f %6.2f %6.2f", PHASE_NAMES[p], lo, avg, p99);
+        renderText(renderer, font, line, x + 10, y + 5 + (p + 2) * lineHeight);
+    }
+    snprintf(line, sizeof(line), "allocs/frame %llu (%llu bytes)", (unsigned long long)lastFrameAllocs.totalCount(),
+             (unsigned long long)lastFrameAllocs.totalBytes());
+    renderText(renderer, font, line, x + 10, y + 5 + (PHASE_COUNT + 2) * lineHeight, lastFrameAllocs.totalCount() ? SDL_Color{255, 90, 90} : SDL_Color{255, 255, 255});
+
+    // Frame-time graph, 2 px per frame, scaled so 33 ms fills the height.
+    int graphTop = y + h - graphHeight - 10;
+    int graphBottom = graphTop + graphHeight;
+    float msToPx = graphHeight / 33.3f;
+    SDL_SetRenderDrawColor(renderer, 90, 90, 90, 255);
+    int budgetY = graphBottom - (int)(1000.0f / TARGET_FPS * msToPx);
+    SDL_RenderDrawLine(renderer, x + 10, budgetY, x + w - 10, budgetY);
+    renderStats.draw(nullptr);
+
+    SDL_Point points[PROFILE_HISTORY];
+    int n = min(profiler.frames, PROFILE_HISTORY);
+    n = min(n, (w - 20) / 2);
+    for (int i = 0; i < n; i++) {
+        int frame = profiler.frames - n + i;
+        float ms = profiler.history[frame % PROFILE_HISTORY][PHASE_COUNT];
+        points[i] = {x + 10 + i * 2, max(graphTop, graphBottom - (int)(ms * msToPx))};
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 255, 120, 255);
+    if (n > 1) {
+        SDL_RenderDrawLines(renderer, points, n);
+        renderStats.draw(nullptr);
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+}
+#endif
+
+void renderMenu(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& menuButtons, TTF_Font* font) {
+    SDL_RenderCopy(renderer, menuTex, NULL, NULL);
+    renderStats.draw(menuTex);
+    for (auto& button : menuButtons) {
+        button.render(renderer, font);
+    }
+}
+
+void renderHowToPlay(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& backButtons,
+                     TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium) {
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+
+    SDL_Color gold = {255, 215, 0};
+    renderText(renderer, fontLarge, "HOW TO PLAY", SCREEN_WIDTH / 2 - 200, 100, gold);
+
+    SDL_Color white = {255, 255, 255};
+    renderText(renderer, fontMedium, "CONTROLS:", SCREEN_WIDTH / 2 - 350, 200, white);
+    renderText(renderer, font, "RIGHT CLICK - Move player to cursor location", SCREEN_WIDTH / 2 - 350, 250);
+    renderText(renderer, font, "ENTER - Place shield in mouse direction (10 second cooldown)", SCREEN_WIDTH / 2 - 350, 300);
+    renderText(renderer, font, "ESC - Return to menu during gameplay", SCREEN_WIDTH / 2 - 350, 350);
+
+    renderText(renderer, fontMedium, "GAMEPLAY:", SCREEN_WIDTH / 2 - 350, 420, white);
+    renderText(renderer, font, "- Dodge incoming bullets from all directions", SCREEN_WIDTH / 2 - 350, 470);
+    renderText(renderer, font, "- Use shields strategically to block bullets", SCREEN_WIDTH / 2 - 350, 520);
+    renderText(renderer, font, "- Survive as long as possible to achieve high score", SCREEN_WIDTH / 2 - 350, 570);
+    renderText(renderer, font, "- Different bullet types have different movement patterns", SCREEN_WIDTH / 2 - 350, 620);
+
+    for (auto& button : backButtons) {
+        button.render(renderer, font);
+    }
+}
+
+void renderSettings(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& settingsButtons,
+                     TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium, int musicVolume, int soundVolume) {
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_Color gold = {255, 215, 0};
+    renderText(renderer, fontLarge, "SETTINGS", SCREEN_WIDTH / 2 - 150, 100, gold);
+    SDL_Color white = {255, 255, 255};
+    renderText(renderer, fontMedium, "Music Volume:", SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT / 2 - 150, white);
+    int musicPercentage = (musicVolume * 100) / MIX_MAX_VOLUME;
+    renderText(renderer, fontMedium, frameArena.format("%d%%", musicPercentage), SCREEN_WIDTH / 2 + 100, SCREEN_HEIGHT / 2 - 150);
+    for (auto& button : settingsButtons) {
+        button.render(renderer, font);
+    }
+}
+
+vector<Button> settingsButtons = {
+    Button(SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT / 2 - 100, 60, 60, "-10%"),
+    Button(SCREEN_WIDTH / 2 + 190, SCREEN_HEIGHT / 2 - 100, 60, 60, "+10%"),
+    Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 100, 200, 40, "BACK TO MENU")
+};
+
+void renderHighscore(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& backButtons,
+                     TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium, const Leaderboard& leaderboard) {
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+
+    SDL_Color gold = {255, 215, 0};
+    renderText(renderer, fontLarge, "HIGH SCORES", SCREEN_WIDTH / 2 - 200, 100, gold);
+
+    vector<ScoreEntry> scores = leaderboard.top(10);
+    SDL_Color white = {255, 255, 255};
+    SDL_Color silver = {192, 192, 192};
+    SDL_Color bronze = {205, 127, 50};
+
+    renderText(renderer, fontMedium, "RANK", SCREEN_WIDTH / 2 - 350, 200, white);
+    renderText(renderer, fontMedium, "NAME", SCREEN_WIDTH / 2 - 150, 200, white);
+    renderText(renderer, fontMedium, "SCORE", SCREEN_WIDTH / 2 + 150, 200, white);
+
+    for (size_t i = 0; i < min(scores.size(), (size_t)10); i++) {
+        SDL_Color rankColor = white;
+        if (i == 0) rankColor = gold;
+        else if (i == 1) rankColor = silver;
+        else if (i == 2) rankColor = bronze;
+
+        renderText(renderer, font, frameArena.format("#%d", (int)i + 1), SCREEN_WIDTH / 2 - 350, 270 + i * 50, rankColor);
+        renderText(renderer, font, scores[i].name, SCREEN_WIDTH / 2 - 150, 270 + i * 50, rankColor);
+        renderText(renderer, font, frameArena.format("%d", scores[i].score), SCREEN_WIDTH / 2 + 150, 270 + i * 50, rankColor);
+    }
+
+    for (auto& button : backButtons) {
+        button.render(renderer, font);
+    }
+}
+
+// The menu, how-to-play, settings and highscore screens only change when the
+// player clicks something or a score comes in. Each is drawn once into its
+// own render-target texture and copied to the window after that, until
+// invalidate() marks it stale. Renderers without target textures draw
+// straight to the window every time.
+struct ScreenCache {
+    SDL_Texture* textures[GAME_STATE_COUNT] = {};
+    bool valid[GAME_STATE_COUNT] = {};
+
+    void invalidate(GameState state) {
+        valid[state] = false;
+    }
+
+    // Target textures lose their contents when the render device is reset.
+    void invalidateAll() {
+        for (auto& v : valid) v = false;
+    }
+
+    void present(SDL_Renderer* renderer, GameState state, const function<void()>& draw) {
+        SDL_Texture*& tex = textures[state];
+        if (!tex) {
+            tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+            if (tex) SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_NONE);
+        }
+        if (!tex) {
+            draw();
+            return;
+        }
+        if (!valid[state]) {
+            SDL_SetRenderTarget(renderer, tex);
+            draw();
+            SDL_SetRenderTarget(renderer, nullptr);
+            valid[state] = true;
+        }
+        SDL_RenderCopy(renderer, tex, nullptr, nullptr);
+        renderStats.draw(tex);
+    }
+
+    void destroy() {
+        for (auto& tex : textures) {
+            if (tex) SDL_DestroyTexture(tex);
+            tex = nullptr;
+        }
+        invalidateAll();
+    }
+};
+
+const float RES_SCALE_MIN = 0.5f;
+const float RES_SCALE_STEP = 0.125f;
+const int RES_WINDOW_FRAMES = 20;
+const float RES_UP_FRACTION = 0.6f;        // scale up only when this far under budget
+const float RES_SOFTWARE_BUDGET_MS = 12.0f; // default budget on the software renderer
+
+// Dynamic resolution for game frames. With a budget set, the world layer
+// (background, shields, bullets, player) is drawn into a render-target
+// texture at scale times the window size and stretched onto the window with
+// one copy; HUD text is then drawn on top at full resolution. Every
+// RES_WINDOW_FRAMES frames the average render+present time is checked
+// against the budget: over it the scale drops a step, well under it the
+// scale climbs back. At full scale the world is drawn straight to the window.
+struct DynamicResolution {
+    SDL_Texture* target = nullptr;
+    float budgetMs = 0;
+    float scale = 1.0f;
+    double windowMs = 0;
+    int windowFrames = 0;
+    bool drawing = false; // between beginWorld and endWorld into target
+
+    bool enable(SDL_Renderer* renderer, float budget) {
+        target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+        if (!target) return false;
+        SDL_SetTextureBlendMode(target, SDL_BLENDMODE_NONE);
+        SDL_SetTextureScaleMode(target, SDL_ScaleModeLinear);
+        budgetMs = budget;
+        return true;
+    }
+
+    void beginWorld(SDL_Renderer* renderer) {
+        drawing = target && scale < 1.0f;
+        if (!drawing) return;
+        SDL_SetRenderTarget(renderer, target);
+        SDL_RenderSetScale(renderer, scale, scale);
+    }
+
+    void endWorld(SDL_Renderer* renderer) {
+        if (!drawing) return;
+        drawing = false;
+        SDL_SetRenderTarget(renderer, nullptr);
+        SDL_RenderSetScale(renderer, 1.0f, 1.0f);
+        SDL_Rect src = {0, 0, (int)(SCREEN_WIDTH * scale + 0.5f), (int)(SCREEN_HEIGHT * scale + 0.5f)};
+        SDL_RenderCopy(renderer, target, &src, nullptr);
+        renderStats.draw(target);
+    }
+
+    void frameTime(float ms) {
+        if (!target) return;
+        windowMs += ms;
+        if (++windowFrames < RES_WINDOW_FRAMES) return;
+        float avg = (float)(windowMs / windowFrames);
+        windowMs = 0;
+        windowFrames = 0;
+        if (avg > budgetMs) {
+            scale = max(RES_SCALE_MIN, scale - RES_SCALE_STEP);
+        } else if (avg < budgetMs * RES_UP_FRACTION) {
+            scale = min(1.0f, scale + RES_SCALE_STEP);
+        }
+    }
+
+    void destroy() {
+        if (target) SDL_DestroyTexture(target);
+        target = nullptr;
+        scale = 1.0f;
+    }
+};
+
+DynamicResolution resolution;
+
+// Particles for impacts: sparks where a shield stops a bullet, a red burst
+// where one hits the player and an explosion when the game ends. They are
+// only for show and never touch the simulation. The pool is
+// struct-of-arrays and allocated once; a SIMD kernel moves every live
+// particle each frame, dead ones are swapped out, and the survivors go to
+// the renderer as untextured quads in one SDL_RenderGeometry call.
+//
+// Past PARTICLE_LOD_COUNT live particles, bursts shrink towards a single
+// particle as the pool fills, and the particles they do spawn are drawn
+// larger and die sooner, so a busy screen keeps the look of each burst for
+// less. No more than PARTICLE_SPAWN_BUDGET particles are spawned a frame.
+const int PARTICLE_CAPACITY = 1 << 17;
+const int PARTICLE_LOD_COUNT = 1 << 15;
+const int PARTICLE_SPAWN_BUDGET = 8192;
+const float PARTICLE_GRAVITY = 400.0f; // pixels per second squared
+const float PARTICLE_DRAG = 0.15f;     // speed left after a second
+
+struct BurstStyle {
+    int count;
+    float speedMin, speedMax; // pixels per second
+    float lifeMin, lifeMax;   // seconds
+    float size;
+    SDL_Color color;
+};
+
+const BurstStyle BURST_STYLES[IMPACT_KINDS] = {
+    {10, 60, 260, 0.25f, 0.5f, 3, {255, 220, 120, 255}},   // IMPACT_BLOCK
+    {16, 80, 320, 0.3f, 0.7f, 4, {255, 60, 40, 255}},      // IMPACT_HIT
+    {600, 40, 700, 0.6f, 1.6f, 5, {255, 150, 30, 255}}     // IMPACT_OVER
+};
+
+// Moves n particles by dt: velocity decays by drag and gains gravity, then
+// position follows and life counts down.
+typedef void (*ParticleUpdateFn)(float* x, float* y, float* vx, float* vy, float* life, int n, float dt, float drag);
+
+void updateParticlesScalar(float* x, float* y, float* vx, float* vy, float* life, int n, float dt, float drag) {
+    float fall = PARTICLE_GRAVITY * dt;
+    for (int i = 0; i < n; i++) {
+        vx[i] *= drag;
+        vy[i] = vy[i] * drag + fall;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        life[i] -= dt;
+    }
+}
+
+#ifdef GAME_X86
+TARGET_SSE2 void updateParticlesSSE2(float* x, float* y, float* vx, float* vy, float* life, int n, float dt, float drag) {
+    const __m128 d = _mm_set1_ps(drag), t = _mm_set1_ps(dt), fall = _mm_set1_ps(PARTICLE_GRAVITY * dt);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 nvx = _mm_mul_ps(_mm_loadu_ps(vx + i), d);
+        __m128 nvy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(vy + i), d), fall);
+        _mm_storeu_ps(vx + i, nvx);
+        _mm_storeu_ps(vy + i, nvy);
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(nvx, t)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(nvy, t)));
+        _mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), t));
+    }
+    updateParticlesScalar(x + i, y + i, vx + i, vy + i, life + i, n - i, dt, drag);
+}
+
+TARGET_AVX2 void updateParticlesAVX2(float* x, float* y, float* vx, float* vy, float* life, int n, float dt, float drag) {
+    const __m256 d = _mm256_set1_ps(drag), t = _mm256_set1_ps(dt), fall = _mm256_set1_ps(PARTICLE_GRAVITY * dt);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 nvx = _mm256_mul_ps(_mm256_loadu_ps(vx + i), d);
+        __m256 nvy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(vy + i), d), fall);
+        _mm256_storeu_ps(vx + i, nvx);
+        _mm256_storeu_ps(vy + i, nvy);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(nvx, t)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(nvy, t)));
+        _mm256_storeu_ps(life + i, _mm256_sub_ps(_mm256_loadu_ps(life + i), t));
+    }
+    updateParticlesScalar(x + i, y + i, vx + i, vy + i, life + i, n - i, dt, drag);
+}
+#endif
+
+ParticleUpdateFn pickParticleUpdate() {
+#ifdef GAME_X86
+    if (SDL_HasAVX2()) return updateParticlesAVX2;
+    if (SDL_HasSSE2()) return updateParticlesSSE2;
+#endif
+    return updateParticlesScalar;
+}
+
+ParticleUpdateFn updateParticles = pickParticleUpdate();
+
+struct ParticleSystem {
+    int capacity = 0;
+    int count = 0;
+    int spawnedThisFrame = 0;
+    vector<float> x, y, vx, vy;
+    vector<float> life, invLife; // seconds left, 1 / seconds at spawn
+    vector<float> size;
+    vector<SDL_Color> color;
+    vector<SDL_Vertex> verts;
+    vector<int> indices; // fixed quad pattern for the whole pool
+    Rng rng{0x5eed};
+
+    void init(int cap = PARTICLE_CAPACITY) {
+        capacity = cap;
+        count = 0;
+        x.resize(cap);
+        y.resize(cap);
+        vx.resize(cap);
+        vy.resize(cap);
+        life.resize(cap);
+        invLife.resize(cap);
+        size.resize(cap);
+        color.resize(cap);
+        verts.resize((size_t)cap * 4);
+        indices.resize((size_t)cap * 6);
+        for (int i = 0; i < cap; i++) {
+            int base = i * 4;
+            int quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+            copy_n(quad, 6, &indices[(size_t)i * 6]);
+        }
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+    void burst(const Impact& impact) {
+        const BurstStyle& style = BURST_STYLES[impact.kind];
+        int n = style.count;
+        float scale = 1.0f;
+        if (count > PARTICLE_LOD_COUNT) {
+            float room = (float)(capacity - count) / (capacity - PARTICLE_LOD_COUNT);
+            n = max(1, (int)(n * room));
+            scale = sqrt((float)style.count / n);
+        }
+        n = min(n, min(capacity - count, PARTICLE_SPAWN_BUDGET - spawnedThisFrame));
+        for (int k = 0; k < n; k++) {
+            int i = count++;
+            float angle = rng.range(6283) * 0.001f;
+            float speed = style.speedMin + rng.range((int)(style.speedMax - style.speedMin) + 1);
+            float seconds = (style.lifeMin + (style.lifeMax - style.lifeMin) * rng.range(1001) * 0.001f) / scale;
+            x[i] = impact.x;
+            y[i] = impact.y;
+            vx[i] = cos(angle) * speed;
+            vy[i] = sin(angle) * speed;
+            life[i] = seconds;
+            invLife[i] = 1.0f / seconds;
+            size[i] = style.size * scale;
+            color[i] = style.color;
+        }
+        spawnedThisFrame += max(0, n);
+    }
+
+    // Advances every particle by dt seconds and drops the ones that died.
+    void update(float dt) {
+        spawnedThisFrame = 0;
+        if (count == 0) return;
+        updateParticles(x.data(), y.data(), vx.data(), vy.data(), life.data(), count, dt, pow(PARTICLE_DRAG, dt));
+        for (int i = 0; i < count;) {
+            if (life[i] > 0) {
+                i++;
+                continue;
+            }
+            int last = --count;
+            x[i] = x[last];
+            y[i] = y[last];
+            vx[i] = vx[last];
+            vy[i] = vy[last];
+            life[i] = life[last];
+            invLife[i] = invLife[last];
+            size[i] = size[last];
+            color[i] = color[last];
+        }
+    }
+
+    // One quad per particle, fading out over its life.
+    void render(SDL_Renderer* renderer) {
+        if (count == 0) return;
+        SDL_Vertex* v = verts.data();
+        for (int i = 0; i < count; i++, v += 4) {
+            float h = size[i] * 0.5f;
+            SDL_Color c = color[i];
+            c.a = (Uint8)(min(1.0f, life[i] * invLife[i] * 2) * 255);
+            v[0] = {{x[i] - h, y[i] - h}, c, {0, 0}};
+            v[1] = {{x[i] + h, y[i] - h}, c, {0, 0}};
+            v[2] = {{x[i] + h, y[i] + h}, c, {0, 0}};
+            v[3] = {{x[i] - h, y[i] + h}, c, {0, 0}};
+        }
+        SDL_BlendMode blend;
+        SDL_GetRenderDrawBlendMode(renderer, &blend);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_ADD);
+        SDL_RenderGeometry(renderer, nullptr, verts.data(), count * 4, indices.data(), count * 6);
+        renderStats.draw(nullptr);
+        SDL_SetRenderDrawBlendMode(renderer, blend);
+    }
+};
+
+// Main-thread effects; empty until init().
+ParticleSystem particles;
+
+const int LATENCY_SAMPLES = 512;
+const int LATENCY_PENDING = 64;
+
+// Input-to-photon latency. Each input handed to the simulation is noted with
+// its SDL event timestamp; once a presented frame shows it, either because
+// the snapshot has taken it in or because late latch drew it, the time from
+// the event to that present becomes a sample. Percentiles cover the last
+// LATENCY_SAMPLES inputs.
+struct LatencyMeter {
+    struct Pending {
+        Uint32 seq;
+        Uint32 eventMs;
+    };
+    Pending pending[LATENCY_PENDING];
+    int pendingCount = 0;
+    float samples[LATENCY_SAMPLES];
+    int sampleCount = 0;
+    int nextSample = 0;
+    Uint32 sent = 0;
+
+    Uint32 add(Uint32 eventMs) {
+        if (pendingCount == LATENCY_PENDING) {
+            memmove(pending, pending + 1, sizeof(Pending) * (LATENCY_PENDING - 1));
+            pendingCount--;
+        }
+        pending[pendingCount++] = Pending{++sent, eventMs};
+        return sent;
+    }
+
+    // applied: inputs the presented snapshot had taken in; latched: the one
+    // input late latch drew this frame, or 0.
+    void presented(Uint32 applied, Uint32 latched, Uint32 presentMs) {
+        int kept = 0;
+        for (int i = 0; i < pendingCount; i++) {
+            const Pending& p = pending[i];
+            if (p.seq <= applied || p.seq == latched) {
+                samples[nextSample] = (float)(presentMs - p.eventMs);
+                nextSample = (nextSample + 1) % LATENCY_SAMPLES;
+                sampleCount = min(sampleCount + 1, LATENCY_SAMPLES);
+            } else {
+                pending[kept++] = p;
+            }
+        }
+        pendingCount = kept;
+    }
+
+    float percentile(double p) const {
+        if (sampleCount == 0) return 0;
+        float sorted[LATENCY_SAMPLES];
+        copy_n(samples, sampleCount, sorted);
+        int k = min(sampleCount - 1, (int)(p * sampleCount));
+        nth_element(sorted, sorted + k, sorted + sampleCount);
+        return sorted[k];
+    }
+};
+
+LatencyMeter inputLatency;
+
+// Crosshair on the latest move target; late latch draws it from input read
+// just before rendering.
+void renderTargetMarker(SDL_Renderer* renderer, int x, int y) {
+    SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
+    SDL_RenderDrawLine(renderer, x - 8, y, x + 8, y);
+    renderStats.draw(nullptr);
+    SDL_RenderDrawLine(renderer, x, y - 8, x, y + 8);
+    renderStats.draw(nullptr);
+}
+
+void renderGame(SDL_Renderer* renderer, SDL_Texture* bgTex, SpriteBatch& batch, const SimSnapshot& view,
+                TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium,
+                int highScore, GameState gameState, float alpha, bool showRenderStats) {
+    resolution.beginWorld(renderer);
+    SDL_Rect screen = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+    SDL_RenderCopy(renderer, bgTex, NULL, &screen);
+    renderStats.draw(bgTex);
+
+    // Sized by pool capacity, not count, so the batch only grows when the pool does.
+    batch.reserve(view.bullets.capacity + GAME_RESERVE_SHIELDS + 1);
+    for (auto& shield : view.shields) {
+        shield.render(batch);
+    }
+    view.bullets.render(batch, alpha);
+    view.player.render(batch, alpha);
+    batch.flush(renderer);
+    particles.render(renderer);
+    resolution.endWorld(renderer);
+
+    int remainingCooldown = view.remainingCooldown;
+    renderText(renderer, font, frameArena.format("Time: %d  High Score: %d", view.survivalTime, highScore), 10, 10);
+
+    SDL_Color cooldownColor = (remainingCooldown > 0) ? SDL_Color{255, 150, 0} : SDL_Color{0, 255, 0};
+    renderText(renderer, font, frameArena.format("Shield Cooldown: %ds", remainingCooldown), 10, 50, cooldownColor);
+
+    if (view.mode == MODE_BULLET_HELL) {
+        renderText(renderer, font, frameArena.format("Health: %d  Bullets: %d", max(0, view.health), view.bullets.count), 10, 130);
+    }
+
+    if (showRenderStats) {
+        renderText(renderer, font, frameArena.format("Draw calls: %d  Texture binds: %d  Input p50/p99: %d/%d ms  Scale: %d%%",
+                                                     lastFrameStats.drawCalls, lastFrameStats.textureBinds,
+                                                     (int)inputLatency.percentile(0.5), (int)inputLatency.percentile(0.99),
+                                                     (int)(resolution.scale * 100 + 0.5f)), 10, 90);
+    }
+
+    if (gameState == GAME_OVER) {
+        SDL_Color red = {255, 0, 0};
+        renderText(renderer, fontLarge, "GAME OVER", SCREEN_WIDTH / 2 - 200, SCREEN_HEIGHT / 2 - 100, red);
+        renderText(renderer, fontMedium, "ENTER to restart - ESC for menu", SCREEN_WIDTH / 2 - 300, SCREEN_HEIGHT / 2);
+    }
+}
+
+// Assets ship as one packed bundle, assets.pak, built by `--pack`. It is a
+// header, a table of contents and the raw file bytes, each aligned to 16, in
+// little-endian order. At runtime the bundle is memory-mapped and assets are
+// read straight out of the mapping. Names are matched case-insensitively,
+// which also covers loose files on disk when no bundle is present.
+const char PAK_MAGIC[8] = {'L', 'O', 'L', 'P', 'A', 'K', '1', '\0'};
+const Uint32 PAK_VERSION = 1;
+const char* PAK_FILE = "assets.pak";
+
+struct PakHeader {
+    char magic[8];
+    Uint32 version;
+    Uint32 count;
+};
+
+struct PakEntry {
+    char name[48];
+    Uint64 offset;
+    Uint64 size;
+};
+
+const char* ASSET_FILES[] = {
+    "background.png", "menu.png", "wall.png", "player1.png", "player2.png",
+    "bullet1.1.png", "bullet1.2.png", "bullet1.3.png", "bullet1.4.png", "bullet2.png", "bullet3.png",
+    "arial.ttf", "background.wav", "explosion.wav", "click.wav", "patterns.txt"
+};
+
+string lowerCase(string s) {
+    for (auto& c : s) c = (char)tolower((unsigned char)c);
+    return s;
+}
+
+// Finds name on disk even when the case of the file differs, e.g. wall.png
+// shipped as wall.PNG. Returns an empty string when nothing matches.
+string findLooseFile(const string& name) {
+    string variants[4] = {name, lowerCase(name), name, name};
+    size_t dot = name.rfind('.');
+    if (dot != string::npos) {
+        for (size_t i = dot; i < name.size(); i++) variants[2][i] = (char)toupper((unsigned char)name[i]);
+    }
+    for (auto& c : variants[3]) c = (char)toupper((unsigned char)c);
+    for (auto& v : variants) {
+        if (FILE* f = fopen(v.c_str(), "rb")) {
+            fclose(f);
+            return v;
+        }
+    }
+    return string();
+}
+
+// --pack <out> [files...]: writes a bundle of the given files, or of every
+// file the game loads when none are listed.
+int runPacker(int argc, char* argv[]) {
+    int first = 1;
+    while (first < argc && strcmp(argv[first], "--pack") != 0) first++;
+    if (first + 1 >= argc) {
+        printf("usage: --pack <out.pak> [files...]\n");
+        return 1;
+    }
+    const char* outPath = argv[first + 1];
+    vector<string> names;
+    for (int i = first + 2; i < argc; i++) names.push_back(argv[i]);
+    if (names.empty()) names.assign(ASSET_FILES, ASSET_FILES + sizeof(ASSET_FILES) / sizeof(ASSET_FILES[0]));
+
+    vector<PakEntry> entries;
+    vector<vector<char>> blobs;
+    for (auto& name : names) {
+        string path = findLooseFile(name);
+        FILE* f = path.empty() ? nullptr : fopen(path.c_str(), "rb");
+        if (!f) {
+            printf("skipping %s: not found\n", name.c_str());
+            continue;
+        }
+        if (name.size() >= sizeof(PakEntry().name)) {
+            printf("skipping %s: name too long\n", name.c_str());
+            fclose(f);
+            continue;
+        }
+        vector<char> bytes;
+        char buffer[65536];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) bytes.insert(bytes.end(), buffer, buffer + n);
+        fclose(f);
+
+        PakEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        strcpy(entry.name, lowerCase(name).c_str());
+        entry.size = bytes.size();
+        entries.push_back(entry);
+        blobs.push_back(bytes);
+    }
+
+    Uint64 offset = sizeof(PakHeader) + entries.size() * sizeof(PakEntry);
+    for (auto& entry : entries) {
+        offset = (offset + 15) & ~(Uint64)15;
+        entry.offset = offset;
+        offset += entry.size;
+    }
+
+    FILE* out = fopen(outPath, "wb");
+    if (!out) {
+        printf("cannot write %s\n", outPath);
+        return 1;
+    }
+    PakHeader header;
+    memcpy(header.magic, PAK_MAGIC, sizeof(header.magic));
+    header.version = PAK_VERSION;
+    header.count = (Uint32)entries.size();
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (!entries.empty()) ok = ok && fwrite(entries.data(), sizeof(PakEntry), entries.size(), out) == entries.size();
+    Uint64 written = sizeof(PakHeader) + entries.size() * sizeof(PakEntry);
+    for (size_t i = 0; ok && i < entries.size(); i++) {
+        static const char zeros[16] = {0};
+        size_t gap = (size_t)(entries[i].offset - written);
+        ok = fwrite(zeros, 1, gap, out) == gap;
+        if (!blobs[i].empty()) ok = ok && fwrite(blobs[i].data(), 1, blobs[i].size(), out) == blobs[i].size();
+        written = entries[i].offset + entries[i].size;
+        printf("%-16s %8llu bytes\n", entries[i].name, (unsigned long long)entries[i].size);
+    }
+    ok = fclose(out) == 0 && ok;
+    // A truncated bundle must not be left where mount() would pick it up.
+    if (!ok) {
+        printf("cannot write %s\n", outPath);
+        remove(outPath);
+        return 1;
+    }
+    printf("wrote %s: %u assets, %llu bytes\n", outPath, header.count, (unsigned long long)written);
+    return 0;
+}
+
+// Read-only memory mapping of a bundle.
+struct AssetBundle {
+    const Uint8* base = nullptr;
+    size_t size = 0;
+    map<string, const PakEntry*> entries;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+
+    bool open(const char* path) {
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        size = (size_t)fileSize.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        base = mapping ? (const Uint8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = (size_t)st.st_size;
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            base = (p == MAP_FAILED) ? nullptr : (const Uint8*)p;
+        }
+        ::close(fd);
+#endif
+        if (!base || size < sizeof(PakHeader)) {
+            close();
+            return false;
+        }
+
+        const PakHeader* header = (const PakHeader*)base;
+        if (memcmp(header->magic, PAK_MAGIC, sizeof(PAK_MAGIC)) != 0 || header->version != PAK_VERSION ||
+            sizeof(PakHeader) + (Uint64)header->count * sizeof(PakEntry) > size) {
+            SDL_Log("%s is not a version %u asset bundle", path, PAK_VERSION);
+            close();
+            return false;
+        }
+        const PakEntry* toc = (const PakEntry*)(base + sizeof(PakHeader));
+        for (Uint32 i = 0; i < header->count; i++) {
+            if (toc[i].offset + toc[i].size > size) continue;
+            string name(toc[i].name, strnlen(toc[i].name, sizeof(toc[i].name)));
+            entries[name] = &toc[i];
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base) munmap((void*)base, size);
+#endif
+        base = nullptr;
+        size = 0;
+        entries.clear();
+    }
+
+    const PakEntry* find(const string& name) const {
+        auto it = entries.find(lowerCase(name));
+        return it == entries.end() ? nullptr : it->second;
+    }
+};
+
+// Hands out SDL_RWops for assets: a view straight into the bundle mapping when
+// the asset is bundled, otherwise the loose file on disk. Safe to call from
+// several threads at once.
+struct AssetLoader {
+    AssetBundle bundle;
+    bool bundled = false;
+
+    void mount(const char* bundlePath) {
+        bundled = bundle.open(bundlePath);
+        SDL_Log(bundled ? "Loading assets from %s" : "No %s, loading loose asset files", bundlePath);
+    }
+
+    SDL_RWops* open(const string& name) const {
+        if (const PakEntry* entry = bundled ? bundle.find(name) : nullptr) {
+            return SDL_RWFromConstMem(bundle.base + entry->offset, (int)entry->size);
+        }
+        string path = findLooseFile(name);
+        return path.empty() ? nullptr : SDL_RWFromFile(path.c_str(), "rb");
+    }
+
+    void close() {
+        bundle.close();
+        bundled = false;
+    }
+};
+
+double millisecondsSince(Uint64 start) {
+    return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Decodes images into surfaces on worker threads. Only texture upload, which
+// SDL requires on the main thread, is left for the caller after finish().
+struct ImageDecoder {
+    struct Job {
+        string name;
+        SDL_Surface* surface = nullptr;
+        double ms = 0;
+    };
+
+    vector<Job> jobs;
+    vector<thread> workers;
+    atomic<int> next{0};
+
+    void start(const AssetLoader& assets, const vector<string>& names) {
+        jobs.resize(names.size());
+        for (size_t i = 0; i < names.size(); i++) jobs[i].name = names[i];
+        int threads = (int)min<size_t>(names.size(), max(1u, thread::hardware_concurrency()));
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([this, &assets] {
+                for (int i; (i = next++) < (int)jobs.size();) {
+                    Uint64 start = SDL_GetPerformanceCounter();
+                    SDL_RWops* rw = assets.open(jobs[i].name);
+                    jobs[i].surface = rw ? IMG_Load_RW(rw, 1) : nullptr;
+                    jobs[i].ms = millisecondsSince(start);
+                }
+            });
+        }
+    }
+
+    void finish() {
+        for (auto& worker : workers) worker.join();
+        workers.clear();
+        for (auto& job : jobs) {
+            if (!job.surface) SDL_Log("Could not load %s", job.name.c_str());
+        }
+    }
+
+    // Hands the decoded surface to the caller.
+    SDL_Surface* take(int i) {
+        SDL_Surface* surface = jobs[i].surface;
+        jobs[i].surface = nullptr;
+        return surface;
+    }
+};
+
+// Audio. --audio-latency picks the device buffer: "normal" is 2048 frames
+// (about 46 ms at 44.1 kHz); "low", the default, tries AUDIO_BUFFER_SIZES from
+// the smallest and keeps the first one whose mixer callbacks arrive on time
+// for AUDIO_PROBE_MS, a sign the device and scheduler can keep it fed. A
+// number asks for that many frames outright.
+const int AUDIO_RATE = 44100;
+const int AUDIO_BUFFER_NORMAL = 2048;
+const int AUDIO_BUFFER_SIZES[] = {256, 512, 1024, 2048};
+const Uint32 AUDIO_PROBE_MS = 150;
+const int AUDIO_VOICES = 16;
+
+struct AudioProbe {
+    atomic<int> calls{0};
+    atomic<Uint64> last{0}, worstGap{0};
+};
+
+void audioProbeCallback(void* data, Uint8*, int) {
+    AudioProbe* probe = (AudioProbe*)data;
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 last = probe->last.exchange(now);
+    if (last && now - last > probe->worstGap) probe->worstGap = now - last;
+    probe->calls++;
+}
+
+// Returns the buffer size in frames, or 0 when no audio device opened.
+int openAudio(const char* latency) {
+    if (latency && strcmp(latency, "low") != 0 && strcmp(latency, "normal") != 0) {
+        int frames = atoi(latency);
+        return frames > 0 && Mix_OpenAudio(AUDIO_RATE, MIX_DEFAULT_FORMAT, 2, frames) == 0 ? frames : 0;
+    }
+    if (!latency || strcmp(latency, "normal") == 0) {
+        return Mix_OpenAudio(AUDIO_RATE, MIX_DEFAULT_FORMAT, 2, AUDIO_BUFFER_NORMAL) == 0 ? AUDIO_BUFFER_NORMAL : 0;
+    }
+    for (int frames : AUDIO_BUFFER_SIZES) {
+        if (Mix_OpenAudio(AUDIO_RATE, MIX_DEFAULT_FORMAT, 2, frames) != 0) continue;
+        if (frames == AUDIO_BUFFER_NORMAL) return frames;
+        AudioProbe probe;
+        Mix_SetPostMix(audioProbeCallback, &probe);
+        SDL_Delay(AUDIO_PROBE_MS);
+        Mix_SetPostMix(nullptr, nullptr);
+
+        // Stable: most of the expected callbacks came, none more than two
+        // buffers late.
+        double period = (double)frames / AUDIO_RATE;
+        double worst = (double)probe.worstGap / SDL_GetPerformanceFrequency();
+        int expected = (int)(AUDIO_PROBE_MS / 1000.0 / period);
+        if (probe.calls >= expected * 3 / 4 && worst <= 2 * period) return frames;
+        SDL_Log("audio buffer of %d frames is unstable (%d/%d callbacks, worst gap %.1f ms)", frames,
+                probe.calls.load(), expected, worst * 1000);
+        Mix_CloseAudio();
+    }
+    return 0;
+}
+
+enum SfxId {
+    SFX_CLICK, SFX_HIT, SFX_EXPLOSION, SFX_COUNT
+};
+
+struct SfxInfo {
+    const char* file;
+    int priority;         // a sound only steals voices of equal or lower priority
+    Uint32 minIntervalMs; // repeats of the same sound closer than this are dropped
+    int volume;
+};
+
+const SfxInfo SFX_INFO[SFX_COUNT] = {
+    {"click.wav", 1, 30, MIX_MAX_VOLUME},
+    {"explosion.wav", 0, 60, MIX_MAX_VOLUME / 3},
+    {"explosion.wav", 2, 0, MIX_MAX_VOLUME}
+};
+
+// Bit per mixer channel, cleared from the audio thread when a voice ends.
+atomic<Uint32> voicesBusy{0};
+
+void onVoiceFinished(int channel) {
+    voicesBusy &= ~(1u << channel);
+}
+
+// Sound effects and the voices playing them. Every file is decoded once
+// after the device is open, and SDL_mixer converts it to the device format
+// as it loads, so playing only mixes samples that are already in memory.
+// play() never queues. Sounds come too close after the same sound are
+// dropped. When all AUDIO_VOICES are busy, the oldest voice of equal or
+// lower priority is cut. A flood of hit events therefore costs a few voices
+// and never backs up the mixer.
+struct SfxBank {
+    Mix_Chunk* chunks[SFX_COUNT] = {};
+    Uint64 lastPlayed[SFX_COUNT] = {};
+    struct Voice {
+        int sfx = -1;
+        Uint64 startedAt = 0;
+    } voices[AUDIO_VOICES];
+    int volume = MIX_MAX_VOLUME;
+
+    void load(const AssetLoader& assets) {
+        Mix_AllocateChannels(AUDIO_VOICES);
+        Mix_ChannelFinished(onVoiceFinished);
+        for (int i = 0; i < SFX_COUNT; i++) {
+            Uint64 loadStart = SDL_GetPerformanceCounter();
+            for (int j = 0; j < i && !chunks[i]; j++) {
+                if (strcmp(SFX_INFO[j].file, SFX_INFO[i].file) == 0) chunks[i] = chunks[j];
+            }
+            if (chunks[i]) continue;
+            SDL_RWops* data = assets.open(SFX_INFO[i].file);
+            chunks[i] = data ? Mix_LoadWAV_RW(data, 1) : nullptr;
+            SDL_Log("asset %-16s %8.2f ms", SFX_INFO[i].file, millisecondsSince(loadStart));
+        }
+    }
+
+    // Returns the channel used, or -1 when the sound was dropped.
+    int play(SfxId id) {
+        const SfxInfo& info = SFX_INFO[id];
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (!chunks[id]) return -1;
+        if (lastPlayed[id] && now - lastPlayed[id] < info.minIntervalMs * SDL_GetPerformanceFrequency() / 1000) return -1;
+
+        Uint32 busy = voicesBusy.load();
+        int channel = -1;
+        for (int i = 0; i < AUDIO_VOICES && channel < 0; i++) {
+            if (!(busy & (1u << i))) channel = i;
+        }
+        if (channel < 0) {
+            for (int i = 0; i < AUDIO_VOICES; i++) {
+                if (voices[i].sfx < 0 || SFX_INFO[voices[i].sfx].priority > info.priority) continue;
+                if (channel < 0 || voices[i].startedAt < voices[channel].startedAt) channel = i;
+            }
+        }
+        if (channel < 0) return -1;
+
+        Mix_Volume(channel, info.volume * volume / MIX_MAX_VOLUME);
+        if (Mix_PlayChannel(channel, chunks[id], 0) < 0) return -1;
+        voicesBusy |= 1u << channel;
+        voices[channel].sfx = id;
+        voices[channel].startedAt = now;
+        lastPlayed[id] = now;
+        return channel;
+    }
+
+    void destroy() {
+        Mix_ChannelFinished(nullptr);
+        Mix_HaltChannel(-1);
+        for (int i = 0; i < SFX_COUNT; i++) {
+            bool shared = false;
+            for (int j = 0; j < i; j++) shared = shared || chunks[j] == chunks[i];
+            if (chunks[i] && !shared) Mix_FreeChunk(chunks[i]);
+        }
+        for (auto& chunk : chunks) chunk = nullptr;
+    }
+};
+
+const char* findArg(int argc, char* argv[], const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return argv[i + 1];
+    }
+    return nullptr;
+}
+
+bool hasFlag(int argc, char* argv[], const char* name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
+
+Uint64 argU64(int argc, char* argv[], const char* name, Uint64 fallback) {
+    const char* value = findArg(argc, argv, name);
+    return value ? strtoull(value, nullptr, 10) : fallback;
+}
+
+// Compiles the bullet patterns into the global set: the file named by
+// --patterns, else patterns.txt from the assets, else DEFAULT_PATTERNS. An
+// asset that does not compile is logged and the built-in set used instead;
+// a --patterns file that does not compile is an error.
+bool loadPatterns(int argc, char* argv[], const AssetLoader& assets) {
+    string text, error;
+    const char* path = findArg(argc, argv, "--patterns");
+    SDL_RWops* rw = path ? SDL_RWFromFile(path, "rb") : assets.open(PATTERN_FILE);
+    if (path && !rw) {
+        SDL_Log("Could not open %s", path);
+        return false;
+    }
+    if (rw) {
+        text.resize((size_t)max((Sint64)0, SDL_RWsize(rw)));
+        if (!text.empty()) text.resize(SDL_RWread(rw, &text[0], 1, text.size()));
+        SDL_RWclose(rw);
+        if (patterns.compile(text, error)) return true;
+        SDL_Log("%s: %s", path ? path : PATTERN_FILE, error.c_str());
+        if (path) return false;
+    }
+    patterns.compile(DEFAULT_PATTERNS, error);
+    return true;
+}
+
+// Replays. A replay is the seed of the first session plus every input that
+// reached the simulation, stamped with the tick it was applied on. Because
+// Game only changes through step() and these inputs, re-applying them to a
+// fresh Game reproduces the run exactly.
+//
+// File layout, little-endian: magic, version, SIM_HZ, first session seed,
+// first session mode, hash of the compiled bullet patterns, then one record
+// per event. A record starts with
+// varint((dticks << 3) | type) where dticks counts from the previous event of
+// the session; target and shield events add the zigzag-varint mouse delta
+// from the previous position, restarts the zigzag-varint seed delta from the
+// first seed and the varint mode, scores the claimed survival time. A file
+// cut short simply ends after its last record. Older files are refused:
+// version 4 had a player that stopped short of its target, version 3 was
+// recorded with end-of-step overlap tests rather than swept collision, and
+// before that with a classic spawner that is gone.
+const char REPLAY_MAGIC[8] = {'L', 'O', 'L', 'R', 'P', 'L', 'Y', '\0'};
+const Uint32 REPLAY_VERSION = 5;
+const Uint32 REPLAY_CHECKPOINT_TICKS = 5 * SIM_HZ;
+
+enum ReplayEventType {
+    REPLAY_END, REPLAY_TARGET, REPLAY_SHIELD, REPLAY_RESTART, REPLAY_SCORE
+};
+
+struct ReplayEvent {
+    Uint32 tick;
+    Uint8 type;
+    int x, y;
+    Uint64 value; // session seed for restarts, survival seconds for scores
+};
+
+// Restarts carry the new session's GameMode in x.
+
+// Feeds one recorded input to the simulation. Scores and the end marker are
+// bookkeeping and leave the game alone.
+void applyInput(Game& game, const ReplayEvent& e) {
+    switch (e.type) {
+        case REPLAY_TARGET: game.setTarget(e.x, e.y); break;
+        case REPLAY_SHIELD: game.placeShield(e.x, e.y); break;
+        case REPLAY_RESTART: game.reset(e.value, (GameMode)e.x); break;
+    }
+}
+
+void putVarint(vector<Uint8>& out, Uint64 v) {
+    while (v >= 0x80) {
+        out.push_back((Uint8)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((Uint8)v);
+}
+
+bool getVarint(const Uint8*& p, const Uint8* end, Uint64& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        Uint8 b = *p++;
+        v |= (Uint64)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+Uint64 zigzag(Sint64 v) {
+    return ((Uint64)v << 1) ^ (Uint64)(v >> 63);
+}
+
+Sint64 unzigzag(Uint64 v) {
+    return (Sint64)(v >> 1) ^ -(Sint64)(v & 1);
+}
+
+void putLE(vector<Uint8>& out, Uint64 v, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back((Uint8)(v >> (8 * i)));
+}
+
+Uint64 getLE(const Uint8* p, int bytes) {
+    Uint64 v = 0;
+    for (int i = 0; i < bytes; i++) v |= (Uint64)p[i] << (8 * i);
+    return v;
+}
+
+struct Replay {
+    Uint64 seed = 0;
+    GameMode mode = MODE_CLASSIC;
+    Uint64 patternHash = 0; // PatternSet::hash the run was recorded with
+    vector<ReplayEvent> events;
+
+    vector<Uint8> encode() const {
+        vector<Uint8> out(REPLAY_MAGIC, REPLAY_MAGIC + 8);
+        putLE(out, REPLAY_VERSION, 4);
+        putLE(out, SIM_HZ, 4);
+        putLE(out, seed, 8);
+        putLE(out, mode, 4);
+        putLE(out, patternHash, 8);
+        Uint32 lastTick = 0;
+        int lastX = 0, lastY = 0;
+        for (auto& e : events) {
+            putVarint(out, (Uint64)(e.tick - lastTick) << 3 | e.type);
+            lastTick = e.tick;
+            if (e.type == REPLAY_TARGET || e.type == REPLAY_SHIELD) {
+                putVarint(out, zigzag(e.x - lastX));
+                putVarint(out, zigzag(e.y - lastY));
+                lastX = e.x;
+                lastY = e.y;
+            } else if (e.type == REPLAY_RESTART) {
+                putVarint(out, zigzag((Sint64)(e.value - seed)));
+                putVarint(out, (Uint64)e.x);
+                lastTick = 0;
+            } else if (e.type == REPLAY_SCORE) {
+                putVarint(out, e.value);
+            }
+        }
+        return out;
+    }
+
+    bool decode(const Uint8* p, size_t size) {
+        const Uint8* end = p + size;
+        if (size < 36 || memcmp(p, REPLAY_MAGIC, 8) != 0) return false;
+        if (getLE(p + 8, 4) != REPLAY_VERSION || getLE(p + 12, 4) != (Uint64)SIM_HZ) return false;
+        seed = getLE(p + 16, 8);
+        mode = (GameMode)getLE(p + 24, 4);
+        patternHash = getLE(p + 28, 8);
+        p += 36;
+
+        events.clear();
+        Uint32 lastTick = 0;
+        int lastX = 0, lastY = 0;
+        while (p < end) {
+            Uint64 head, a, b;
+            if (!getVarint(p, end, head)) return false;
+            ReplayEvent e = {lastTick + (Uint32)(head >> 3), (Uint8)(head & 7), 0, 0, 0};
+            lastTick = e.tick;
+            if (e.type == REPLAY_TARGET || e.type == REPLAY_SHIELD) {
+                if (!getVarint(p, end, a) || !getVarint(p, end, b)) return false;
+                e.x = lastX += (int)unzigzag(a);
+                e.y = lastY += (int)unzigzag(b);
+            } else if (e.type == REPLAY_RESTART) {
+                if (!getVarint(p, end, a)) return false;
+                if (!getVarint(p, end, b)) return false;
+                e.value = seed + (Uint64)unzigzag(a);
+                e.x = (int)b;
+                lastTick = 0;
+            } else if (e.type == REPLAY_SCORE) {
+                if (!getVarint(p, end, e.value)) return false;
+            } else if (e.type != REPLAY_END) {
+                return false;
+            }
+            events.push_back(e);
+            if (e.type == REPLAY_END) break;
+        }
+        return true;
+    }
+
+    bool save(const string& path) const {
+        vector<Uint8> bytes = encode();
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+        return fclose(f) == 0 && ok;
+    }
+
+    bool load(const string& path) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return false;
+        vector<Uint8> bytes;
+        Uint8 chunk[65536];
+        for (size_t n; (n = fread(chunk, 1, sizeof(chunk), f)) > 0;) bytes.insert(bytes.end(), chunk, chunk + n);
+        fclose(f);
+        return decode(bytes.data(), bytes.size());
+    }
+};
+
+// Collects inputs while playing when --record is given. The file is
+// rewritten after every finished session so a crash loses at most one.
+struct ReplayRecorder {
+    Replay replay;
+    string path;
+
+    void start(const char* file, Uint64 seed, GameMode mode) {
+        if (file) path = file;
+        replay.seed = seed;
+        replay.mode = mode;
+        replay.patternHash = patterns.hash;
+        replay.events.clear();
+    }
+
+    void add(const ReplayEvent& e) {
+        if (path.empty()) return;
+        replay.events.push_back(e);
+        if (e.type == REPLAY_SCORE || e.type == REPLAY_END) replay.save(path);
+    }
+};
+
+// Re-simulates a replay one tick at a time. Every REPLAY_CHECKPOINT_TICKS it
+// keeps a copy of the game so seeking backwards only re-runs a few seconds.
+// Scores claimed in the file are checked against the simulation as they go.
+struct ReplayPlayer {
+    struct Checkpoint {
+        Uint64 elapsed;
+        size_t next;
+        Game game;
+        size_t scores, sessions;
+        int mismatches;
+    };
+
+    const Replay* replay = nullptr;
+    bool seekable = true; // keep checkpoints; verification turns this off
+    Game game;
+    size_t next = 0;
+    Uint64 elapsed = 0; // ticks simulated across all sessions
+    bool done = false;
+    bool desynced = false;
+    int mismatches = 0;
+    vector<int> scores;
+    vector<Uint32> sessionTicks; // final tick of every session played out
+    vector<Checkpoint> checkpoints;
+
+    void start(const Replay& r) {
+        replay = &r;
+        game.reset(r.seed, r.mode);
+        next = 0;
+        elapsed = 0;
+        done = desynced = false;
+        mismatches = 0;
+        scores.clear();
+        sessionTicks.clear();
+        checkpoints.clear();
+        checkpoints.push_back(Checkpoint{0, 0, game, 0, 0, 0});
+    }
+
+    // Applies the inputs due on the current tick, then steps. Returns false
+    // once the replay has ended.
+    bool advance() {
+        const vector<ReplayEvent>& events = replay->events;
+        while (!done && next < events.size() && events[next].tick <= game.tick) {
+            const ReplayEvent& e = events[next++];
+            if (e.tick != game.tick || e.type == REPLAY_END) {
+                desynced = e.tick != game.tick;
+                done = true;
+            } else if (e.type == REPLAY_SCORE) {
+                if (!game.over || (Uint64)game.survivalTime() != e.value) mismatches++;
+                scores.push_back(game.survivalTime());
+            } else {
+                if (e.type == REPLAY_RESTART) sessionTicks.push_back(game.tick);
+                applyInput(game, e);
+            }
+        }
+        if (next == events.size()) done = true;
+        // Only a restart moves a finished game on; none is due, so the file
+        // and the simulation disagree.
+        if (!done && game.over) desynced = done = true;
+        if (done) {
+            sessionTicks.push_back(game.tick);
+            return false;
+        }
+        game.step();
+        elapsed++;
+        if (seekable && elapsed % REPLAY_CHECKPOINT_TICKS == 0 && checkpoints.back().elapsed < elapsed) {
+            checkpoints.push_back(Checkpoint{elapsed, next, game, scores.size(), sessionTicks.size(), mismatches});
+            checkpoints.back().game.spare = BulletPool(0); // scratch, no need to keep it
+        }
+        return true;
+    }
+
+    void seek(Uint64 target) {
+        int i = (int)checkpoints.size() - 1;
+        while (i > 0 && checkpoints[i].elapsed > target) i--;
+        if (checkpoints[i].elapsed > elapsed || target < elapsed) {
+            const Checkpoint& c = checkpoints[i];
+            elapsed = c.elapsed;
+            next = c.next;
+            game = c.game;
+            scores.resize(c.scores);
+            sessionTicks.resize(c.sessions);
+            mismatches = c.mismatches;
+            done = desynced = false;
+        }
+        while (elapsed < target && advance()) {}
+    }
+};
+
+// Bounded queue for exactly one producer thread and one consumer thread.
+template <class T, int N>
+struct SpscQueue {
+    T items[N];
+    atomic<Uint32> head{0}, tail{0};
+
+    bool push(const T& item) {
+        Uint32 h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) == (Uint32)N) return false;
+        items[h % N] = item;
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool pending() const {
+        return head.load(memory_order_acquire) != tail.load(memory_order_relaxed);
+    }
+
+    bool pop(T& item) {
+        Uint32 t = tail.load(memory_order_relaxed);
+        if (t == head.load(memory_order_acquire)) return false;
+        item = items[t % N];
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+};
+
+// Spectator stream. Every published tick is encoded into a ring inside a
+// memory-mapped file; any number of `--spectate <file>` processes map the same
+// file and draw whatever is newest at their own frame rate. The game never
+// waits on them and never knows how many there are.
+//
+// Positions travel in 1/256 px and velocities in 1/256 px per tick. Both ends
+// move every bullet by its velocity each tick, and the encoder keeps an exact
+// copy of what a viewer holds, so between keyframes a packet carries only
+// what that prediction gets wrong: removed bullets, bullets more than
+// SPECTATE_TOLERANCE off (turning or accelerating ones, or rounding that has
+// built up) and new ones. A straight bullet costs bytes when it appears and
+// when it goes, so the stream grows with what changes, not with the count.
+//
+// Packet: u8 flags, varint tick, survival seconds and cooldown seconds,
+// zigzag health, player x and y. With SPECTATE_SHIELDS: varint count, then
+// zigzag x, y and varint w, h per shield. A keyframe then lists every bullet
+// as varint id step, zigzag x, y, vx, vy and a u8 sprite. A delta lists the
+// removed ids, then corrections (id step and zigzag dx, dy, dvx, dvy against
+// the prediction), then spawns laid out as in a keyframe; each list starts
+// with a varint count. Id steps count up from the previous id in the list.
+const Uint8 SPECTATE_KEY = 1;
+const Uint8 SPECTATE_OVER = 2;
+const Uint8 SPECTATE_HELL = 4;
+const Uint8 SPECTATE_FACING_RIGHT = 8;
+const Uint8 SPECTATE_SHIELDS = 16;
+const float SPECTATE_UNITS = 256.0f;     // per pixel
+const Sint32 SPECTATE_TOLERANCE = 64;    // a quarter pixel
+const Uint32 SPECTATE_KEY_TICKS = SIM_HZ; // a keyframe every second at most
+
+struct SpectatorBullet {
+    Uint32 id;
+    Sint32 x, y, vx, vy;
+    Uint8 tex;
+};
+
+// What a viewer knows: the newest state it decoded, bullets in id order.
+struct SpectatorView {
+    bool valid = false; // a keyframe has arrived
+    Uint32 tick = 0;
+    Uint8 flags = 0;
+    int survivalTime = 0, remainingCooldown = 0, health = 0;
+    int playerX = 0, playerY = 0;
+    vector<SDL_Rect> shields;
+    vector<SpectatorBullet> bullets;
+    vector<SpectatorBullet> merged, fixes; // scratch
+    vector<Uint32> removed;
+
+    void advance(Uint32 ticks) {
+        for (auto& b : bullets) {
+            b.x += b.vx * (Sint32)ticks;
+            b.y += b.vy * (Sint32)ticks;
+        }
+    }
+
+    static bool getBullet(const Uint8*& p, const Uint8* end, Uint32& id, SpectatorBullet& b) {
+        Uint64 step, x, y, vx, vy;
+        if (!getVarint(p, end, step) || !getVarint(p, end, x) || !getVarint(p, end, y) ||
+            !getVarint(p, end, vx) || !getVarint(p, end, vy) || p >= end) return false;
+        b.id = id += (Uint32)step;
+        b.x = (Sint32)unzigzag(x);
+        b.y = (Sint32)unzigzag(y);
+        b.vx = (Sint32)unzigzag(vx);
+        b.vy = (Sint32)unzigzag(vy);
+        b.tex = *p++;
+        return true;
+    }
+
+    // Decodes one packet on top of the current state. Deltas are ignored
+    // until a keyframe has arrived; false on a packet that is cut short.
+    bool apply(const Uint8* p, size_t size) {
+        const Uint8* end = p + size;
+        if (p >= end) return false;
+        Uint8 f = *p++;
+        Uint64 t, survival, cooldown, hp, px, py;
+        if (!getVarint(p, end, t) || !getVarint(p, end, survival) || !getVarint(p, end, cooldown) ||
+            !getVarint(p, end, hp) || !getVarint(p, end, px) || !getVarint(p, end, py)) return false;
+        bool key = f & SPECTATE_KEY;
+        if (!key && (!valid || (Uint32)t < tick)) return true;
+
+        if (f & SPECTATE_SHIELDS) {
+            Uint64 n, sx, sy, sw, sh;
+            if (!getVarint(p, end, n) || n > size) return false;
+            shields.clear();
+            for (Uint64 i = 0; i < n; i++) {
+                if (!getVarint(p, end, sx) || !getVarint(p, end, sy) || !getVarint(p, end, sw) || !getVarint(p, end, sh)) return false;
+                shields.push_back(SDL_Rect{(int)unzigzag(sx), (int)unzigzag(sy), (int)sw, (int)sh});
+            }
+        }
+
+        Uint64 n;
+        Uint32 id = 0;
+        SpectatorBullet b;
+        if (key) {
+            if (!getVarint(p, end, n) || n > size) return false;
+            bullets.clear();
+            for (Uint64 i = 0; i < n; i++) {
+                if (!getBullet(p, end, id, b)) return false;
+                bullets.push_back(b);
+            }
+        } else {
+            advance((Uint32)t - tick);
+            Uint64 step, dx, dy, dvx, dvy;
+            if (!getVarint(p, end, n) || n > size) return false;
+            removed.clear();
+            for (Uint64 i = 0; i < n; i++) {
+                if (!getVarint(p, end, step)) return false;
+                removed.push_back(id += (Uint32)step);
+            }
+            if (!getVarint(p, end, n) || n > size) return false;
+            fixes.clear();
+            id = 0;
+            for (Uint64 i = 0; i < n; i++) {
+                if (!getVarint(p, end, step) || !getVarint(p, end, dx) || !getVarint(p, end, dy) ||
+                    !getVarint(p, end, dvx) || !getVarint(p, end, dvy)) return false;
+                fixes.push_back(SpectatorBullet{id += (Uint32)step, (Sint32)unzigzag(dx), (Sint32)unzigzag(dy),
+                                                (Sint32)unzigzag(dvx), (Sint32)unzigzag(dvy), 0});
+            }
+
+            // Both lists are in id order like the bullets, so one pass does both.
+            merged.clear();
+            size_t r = 0, c = 0;
+            for (const auto& old : bullets) {
+                while (r < removed.size() && removed[r] < old.id) r++;
+                if (r < removed.size() && removed[r] == old.id) continue;
+                b = old;
+                while (c < fixes.size() && fixes[c].id < old.id) c++;
+                if (c < fixes.size() && fixes[c].id == old.id) {
+                    b.x += fixes[c].x;
+                    b.y += fixes[c].y;
+                    b.vx += fixes[c].vx;
+                    b.vy += fixes[c].vy;
+                }
+                merged.push_back(b);
+            }
+            swap(bullets, merged);
+
+            // New ids are higher than any the viewer holds, so spawns append.
+            if (!getVarint(p, end, n) || n > size) return false;
+            id = 0;
+            for (Uint64 i = 0; i < n; i++) {
+                if (!getBullet(p, end, id, b)) return false;
+                bullets.push_back(b);
+            }
+        }
+
+        valid = true;
+        tick = (Uint32)t;
+        flags = f;
+        survivalTime = (int)survival;
+        remainingCooldown = (int)cooldown;
+        health = (int)unzigzag(hp);
+        playerX = (int)unzigzag(px);
+        playerY = (int)unzigzag(py);
+        return true;
+    }
+
+    // The decoded state as a snapshot for renderGame.
+    void fill(SimSnapshot& s) const {
+        s.player.rect = {playerX, playerY, 60, 60};
+        s.player.placeAt(playerX, playerY);
+        s.player.facingRight = flags & SPECTATE_FACING_RIGHT;
+        int n = (int)bullets.size();
+        if (s.bullets.capacity < n) s.bullets.setCapacity(max(BULLET_CAPACITY, n * 2));
+        s.bullets.count = n;
+        for (int i = 0; i < n; i++) {
+            s.bullets.x[i] = s.bullets.prevX[i] = bullets[i].x / SPECTATE_UNITS;
+            s.bullets.y[i] = s.bullets.prevY[i] = bullets[i].y / SPECTATE_UNITS;
+            s.bullets.texIndex[i] = bullets[i].tex;
+        }
+        s.shields.clear();
+        for (const auto& r : shields) {
+            s.shields.push_back(Shield(0, 0, true, 0));
+            s.shields.back().rect = r;
+        }
+        s.mode = (flags & SPECTATE_HELL) ? MODE_BULLET_HELL : MODE_CLASSIC;
+        s.survivalTime = survivalTime;
+        s.remainingCooldown = remainingCooldown;
+        s.health = health;
+        s.over = flags & SPECTATE_OVER;
+    }
+};
+
+// Turns game states into packets. Holds a viewer's copy of the state to
+// predict from and to measure corrections against.
+struct SpectatorEncoder {
+    SpectatorView mirror;
+    vector<int> order; // pool indices in id order
+    vector<SpectatorBullet> spawns;
+    Uint32 lastKey = 0;
+
+    SpectatorBullet quantize(const BulletPool& pool, int i) const {
+        return SpectatorBullet{pool.id[i], (Sint32)lround(pool.x[i] * SPECTATE_UNITS), (Sint32)lround(pool.y[i] * SPECTATE_UNITS),
+                               (Sint32)lround(pool.vx[i] * (SPECTATE_UNITS / SIM_HZ)),
+                               (Sint32)lround(pool.vy[i] * (SPECTATE_UNITS / SIM_HZ)), pool.texIndex[i]};
+    }
+
+    static void putBullet(vector<Uint8>& out, Uint32& id, const SpectatorBullet& b) {
+        putVarint(out, b.id - id);
+        id = b.id;
+        putVarint(out, zigzag(b.x));
+        putVarint(out, zigzag(b.y));
+        putVarint(out, zigzag(b.vx));
+        putVarint(out, zigzag(b.vy));
+        out.push_back(b.tex);
+    }
+
+    // Appends the packet for the game's current state to out. False when the
+    // tick has not moved since the last packet; key says whether it was a
+    // keyframe.
+    bool encode(const Game& game, vector<Uint8>& out, bool& key) {
+        if (mirror.valid && game.tick == mirror.tick) return false;
+        // A restart or a replay seek goes back in time; start over from a keyframe.
+        key = !mirror.valid || game.tick < mirror.tick || game.tick - lastKey >= SPECTATE_KEY_TICKS;
+
+        // Bullet hell compaction keeps the pool in id order; classic removal
+        // swaps the last bullet into the gap, so it is sorted when it is not.
+        const BulletPool& pool = game.bullets;
+        order.resize(pool.count);
+        bool sorted = true;
+        for (int i = 0; i < pool.count; i++) {
+            order[i] = i;
+            if (i > 0 && pool.id[i] < pool.id[i - 1]) sorted = false;
+        }
+        if (!sorted) sort(order.begin(), order.end(), [&](int a, int b) { return pool.id[a] < pool.id[b]; });
+
+        bool shieldsChanged = key || game.shields.size() != mirror.shields.size();
+        for (size_t i = 0; !shieldsChanged && i < game.shields.size(); i++) {
+            const SDL_Rect& a = game.shields[i].rect;
+            const SDL_Rect& b = mirror.shields[i];
+            shieldsChanged = a.x != b.x || a.y != b.y || a.w != b.w || a.h != b.h;
+        }
+
+        Uint8 f = (key ? SPECTATE_KEY : 0) | (game.over ? SPECTATE_OVER : 0) |
+                  (game.mode == MODE_BULLET_HELL ? SPECTATE_HELL : 0) |
+                  (game.player.facingRight ? SPECTATE_FACING_RIGHT : 0) | (shieldsChanged ? SPECTATE_SHIELDS : 0);
+        out.push_back(f);
+        putVarint(out, game.tick);
+        putVarint(out, (Uint64)game.survivalTime());
+        putVarint(out, (Uint64)game.remainingCooldown());
+        putVarint(out, zigzag(game.health));
+        putVarint(out, zigzag(game.player.rect.x));
+        putVarint(out, zigzag(game.player.rect.y));
+        if (shieldsChanged) {
+            putVarint(out, game.shields.size());
+            mirror.shields.clear();
+            for (const auto& s : game.shields) {
+                putVarint(out, zigzag(s.rect.x));
+                putVarint(out, zigzag(s.rect.y));
+                putVarint(out, (Uint64)s.rect.w);
+                putVarint(out, (Uint64)s.rect.h);
+                mirror.shields.push_back(s.rect);
+            }
+        }
+
+        Uint32 id = 0;
+        if (key) {
+            putVarint(out, order.size());
+            mirror.bullets.clear();
+            for (int i : order) {
+                SpectatorBullet b = quantize(pool, i);
+                putBullet(out, id, b);
+                mirror.bullets.push_back(b);
+            }
+            lastKey = game.tick;
+        } else {
+            // Walk the prediction and the pool together in id order.
+            mirror.advance(game.tick - mirror.tick);
+            vector<SpectatorBullet>& known = mirror.bullets;
+            mirror.removed.clear();
+            mirror.fixes.clear();
+            mirror.merged.clear();
+            spawns.clear();
+            size_t j = 0;
+            for (int i : order) {
+                SpectatorBullet b = quantize(pool, i);
+                for (; j < known.size() && known[j].id < b.id; j++) mirror.removed.push_back(known[j].id);
+                if (j < known.size() && known[j].id == b.id) {
+                    const SpectatorBullet& guess = known[j++];
+                    if (abs(b.x - guess.x) > SPECTATE_TOLERANCE || abs(b.y - guess.y) > SPECTATE_TOLERANCE) {
+                        mirror.fixes.push_back(SpectatorBullet{b.id, b.x - guess.x, b.y - guess.y, b.vx - guess.vx, b.vy - guess.vy, 0});
+                        mirror.merged.push_back(b);
+                    } else {
+                        mirror.merged.push_back(guess);
+                    }
+                } else {
+                    spawns.push_back(b);
+                    mirror.merged.push_back(b);
+                }
+            }
+            for (; j < known.size(); j++) mirror.removed.push_back(known[j].id);
+            swap(known, mirror.merged);
+
+            putVarint(out, mirror.removed.size());
+            for (Uint32 r : mirror.removed) {
+                putVarint(out, r - id);
+                id = r;
+            }
+            putVarint(out, mirror.fixes.size());
+            id = 0;
+            for (const auto& d : mirror.fixes) {
+                putVarint(out, d.id - id);
+                id = d.id;
+                putVarint(out, zigzag(d.x));
+                putVarint(out, zigzag(d.y));
+                putVarint(out, zigzag(d.vx));
+                putVarint(out, zigzag(d.vy));
+            }
+            putVarint(out, spawns.size());
+            id = 0;
+            for (const auto& b : spawns) putBullet(out, id, b);
+        }
+
+        mirror.valid = true;
+        mirror.tick = game.tick;
+        mirror.flags = f;
+        return true;
+    }
+};
+
+// The ring the packets travel through: a file mapped by the game for writing
+// and by each viewer for reading. Packets are a u32 length and the bytes,
+// laid end to end at stream offsets that only grow; offset o lives at
+// o % capacity in the data area. The writer announces the end of what it is
+// about to overwrite in `writing`, copies, then publishes the new end in
+// `head`. A reader copies a packet out and then checks `writing` to see
+// whether the writer lapped it meanwhile; a reader that falls behind or
+// starts late jumps to the newest keyframe.
+const char SPECTATE_MAGIC[8] = {'L', 'O', 'L', 'S', 'P', 'E', 'C', '\0'};
+const Uint32 SPECTATE_VERSION = 1;
+const Uint64 SPECTATE_RING_BYTES = 32 << 20;
+const size_t SPECTATE_DATA_OFFSET = 64;
+
+struct SpectateRingHeader {
+    char magic[8];
+    Uint32 version;
+    Uint32 reserved;
+    Uint64 capacity;
+    atomic<Uint64> head;     // end of the last whole packet
+    atomic<Uint64> writing;  // end of the packet being written
+    atomic<Uint64> keyframe; // 1 + offset of the newest keyframe, 0 before the first
+};
+
+struct SpectateRing {
+    Uint8* base = nullptr;
+    size_t size = 0;
+    Uint64 cursor = 0; // reader: offset of the next packet
+    bool synced = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+
+    SpectateRingHeader* header() const {
+        return (SpectateRingHeader*)base;
+    }
+
+    Uint8* data() const {
+        return base + SPECTATE_DATA_OFFSET;
+    }
+
+    bool map(const char* path, bool write, Uint64 capacity) {
+#ifdef _WIN32
+        file = CreateFileA(path, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL, write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        if (write) {
+            size = (size_t)(SPECTATE_DATA_OFFSET + capacity);
+        } else {
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file, &fileSize);
+            size = (size_t)fileSize.QuadPart;
+        }
+        mapping = size ? CreateFileMappingA(file, NULL, write ? PAGE_READWRITE : PAGE_READONLY, (DWORD)((Uint64)size >> 32),
+                                            (DWORD)size, NULL) : NULL;
+        base = mapping ? (Uint8*)MapViewOfFile(mapping, write ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+        int fd = write ? ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (write) {
+            size = (size_t)(SPECTATE_DATA_OFFSET + capacity);
+            if (ftruncate(fd, (off_t)size) != 0) size = 0;
+        } else if (fstat(fd, &st) == 0) {
+            size = (size_t)st.st_size;
+        }
+        if (size) {
+            void* p = mmap(nullptr, size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            base = (p == MAP_FAILED) ? nullptr : (Uint8*)p;
+        }
+        ::close(fd);
+#endif
+        if (!base || size < SPECTATE_DATA_OFFSET) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Writer side: a fresh ring, emptying whatever the file held.
+    bool create(const char* path, Uint64 capacity = SPECTATE_RING_BYTES) {
+        if (!map(path, true, capacity)) return false;
+        SpectateRingHeader* h = header();
+        memcpy(h->magic, SPECTATE_MAGIC, sizeof(SPECTATE_MAGIC));
+        h->version = SPECTATE_VERSION;
+        h->reserved = 0;
+        h->capacity = capacity;
+        h->head.store(0);
+        h->writing.store(0);
+        h->keyframe.store(0);
+        return true;
+    }
+
+    // Reader side: false until the game has created the ring.
+    bool attach(const char* path) {
+        if (!map(path, false, 0)) return false;
+        const SpectateRingHeader* h = header();
+        if (memcmp(h->magic, SPECTATE_MAGIC, sizeof(SPECTATE_MAGIC)) != 0 || h->version != SPECTATE_VERSION ||
+            SPECTATE_DATA_OFFSET + h->capacity > size) {
+            close();
+            return false;
+        }
+        synced = false;
+        return true;
+    }
+
+    void copyIn(Uint64 offset, const Uint8* src, size_t n) {
+        Uint64 capacity = header()->capacity;
+        size_t at = (size_t)(offset % capacity);
+        size_t first = min(n, (size_t)(capacity - at));
+        memcpy(data() + at, src, first);
+        memcpy(data(), src + first, n - first);
+    }
+
+    void copyOut(Uint64 offset, Uint8* dst, size_t n) const {
+        Uint64 capacity = header()->capacity;
+        size_t at = (size_t)(offset % capacity);
+        size_t first = min(n, (size_t)(capacity - at));
+        memcpy(dst, data() + at, first);
+        memcpy(dst + first, data(), n - first);
+    }
+
+    // Never blocks; a packet over half the ring is dropped.
+    bool write(const vector<Uint8>& packet, bool key) {
+        SpectateRingHeader* h = header();
+        Uint64 start = h->head.load(memory_order_relaxed);
+        Uint64 end = start + 4 + packet.size();
+        if (4 + packet.size() > h->capacity / 2) return false;
+        h->writing.store(end, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        Uint8 length[4] = {(Uint8)packet.size(), (Uint8)(packet.size() >> 8), (Uint8)(packet.size() >> 16), (Uint8)(packet.size() >> 24)};
+        copyIn(start, length, 4);
+        copyIn(start + 4, packet.data(), packet.size());
+        h->head.store(end, memory_order_release);
+        if (key) h->keyframe.store(start + 1, memory_order_release);
+        return true;
+    }
+
+    // Reader side: the next packet, or false when there is nothing new.
+    bool read(vector<Uint8>& packet) {
+        const SpectateRingHeader* h = header();
+        Uint64 capacity = h->capacity;
+        Uint64 head = h->head.load(memory_order_acquire);
+        if (!synced || cursor > head || head - cursor > capacity) {
+            // Started late, lapped, or the game restarted the ring.
+            Uint64 key = h->keyframe.load(memory_order_acquire);
+            if (!key || key - 1 > head || head - (key - 1) > capacity) return false;
+            cursor = key - 1;
+            synced = true;
+        }
+        if (cursor + 4 > head) return false;
+        Uint8 length[4];
+        copyOut(cursor, length, 4);
+        Uint64 n = length[0] | (Uint64)length[1] << 8 | (Uint64)length[2] << 16 | (Uint64)length[3] << 24;
+        if (cursor + 4 + n > head) {
+            synced = false;
+            return false;
+        }
+        packet.resize((size_t)n);
+        copyOut(cursor + 4, packet.data(), (size_t)n);
+        atomic_thread_fence(memory_order_acquire);
+        if (h->writing.load(memory_order_relaxed) - cursor > capacity) {
+            synced = false; // overwritten while we copied
+            return false;
+        }
+        cursor += 4 + n;
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base) munmap((void*)base, size);
+#endif
+        base = nullptr;
+        size = 0;
+    }
+};
+
+// The game's end: encodes each new tick and drops it into the ring.
+struct SpectatorPublisher {
+    SpectatorEncoder encoder;
+    SpectateRing ring;
+    vector<Uint8> packet;
+    Uint64 packets = 0, bytes = 0;
+
+    bool open(const char* path) {
+        if (!ring.create(path)) {
+            SDL_Log("cannot create spectator stream %s", path);
+            return false;
+        }
+        return true;
+    }
+
+    void publish(const Game& game) {
+        bool key;
+        packet.clear();
+        if (!encoder.encode(game, packet, key)) return;
+        if (ring.write(packet, key)) {
+            packets++;
+            bytes += packet.size();
+        }
+    }
+
+    void close() {
+        ring.close();
+    }
+};
+
+enum SimCommandType {
+    SIM_INPUT, SIM_SEEK, SIM_REPLAY_RESTART
+};
+
+struct SimCommand {
+    SimCommandType type;
+    ReplayEvent input; // SIM_INPUT; the tick is stamped when it is applied
+    Sint64 ticks;      // SIM_SEEK
+};
+
+// Runs the simulation on its own thread at SIM_HZ, so a slow present or text
+// upload on the main thread no longer holds it up. Commands from the main
+// thread arrive through an SPSC queue and are applied (and recorded) on the
+// next tick boundary. After each batch of steps the result is published as a
+// SimSnapshot through a triple buffer. The sim only advances while running is
+// set, which the main thread keeps in line with its PLAYING state.
+struct SimThread {
+    Game game;
+    ReplayRecorder recorder;
+    const Replay* replay = nullptr;
+    ReplayPlayer playback;
+    SpectatorPublisher* spectators = nullptr; // --spectate-out
+    // Impacts the main thread has not taken yet, numbered from impactBase.
+    // Every snapshot carries all of them, so one the main thread skips loses
+    // nothing; it reports how far it got in impactsTaken.
+    vector<Impact> impacts;
+    Uint32 impactBase = 0;
+    atomic<Uint32> impactsTaken{0};
+    // Bumped by every command that can take a finished game back to playing,
+    // so the main thread can tell a stale "over" snapshot from a fresh one.
+    Uint32 generation = 0;
+    Uint32 inputsApplied = 0;
+
+    SpscQueue<SimCommand, 256> commands;
+    TripleBuffer<SimSnapshot> snapshots;
+    atomic<bool> running{false};
+    atomic<bool> stopping{false};
+    thread worker;
+    // Wakes the thread between ticks so a command is applied and published
+    // as soon as it arrives instead of on the next tick.
+    mutex wakeLock;
+    condition_variable wake;
+
+    void start(Uint64 seed, const char* recordPath, const Replay* r) {
+        game.reset(seed);
+        recorder.start(recordPath, seed, MODE_CLASSIC);
+        impacts.reserve(IMPACT_BUDGET);
+        replay = r;
+        if (replay) playback.start(*replay);
+        publish(SDL_GetPerformanceCounter());
+        worker = thread([this] { run(); });
+    }
+
+    void send(const SimCommand& c) {
+        while (!commands.push(c)) this_thread::yield();
+        notify();
+    }
+
+    void notify() {
+        { lock_guard<mutex> lock(wakeLock); }
+        wake.notify_one();
+    }
+
+    // Starting wakes the thread out of its idle wait.
+    void setRunning(bool on) {
+        if (running.exchange(on) != on) notify();
+    }
+
+    void stop() {
+        stopping = true;
+        notify();
+        if (worker.joinable()) worker.join();
+        recorder.add(ReplayEvent{game.tick, REPLAY_END, 0, 0, 0});
+    }
+
+    void apply(SimCommand& c) {
+        if (c.type == SIM_INPUT) inputsApplied++;
+        if (c.type == SIM_INPUT && !replay) {
+            c.input.tick = game.tick;
+            recorder.add(c.input);
+            applyInput(game, c.input);
+            if (c.input.type == REPLAY_RESTART) generation++;
+        } else if (c.type == SIM_SEEK && replay) {
+            Sint64 target = (Sint64)playback.elapsed + c.ticks;
+            playback.seek(target > 0 ? (Uint64)target : 0);
+            playback.game.impacts.clear(); // from the ticks skipped over
+            generation++;
+        } else if (c.type == SIM_REPLAY_RESTART && replay) {
+            playback.start(*replay);
+            generation++;
+        }
+    }
+
+    void step() {
+        if (replay) {
+            playback.advance();
+        } else if (!game.over) {
+            game.step();
+            if (game.over) recorder.add(ReplayEvent{game.tick, REPLAY_SCORE, 0, 0, (Uint64)game.survivalTime()});
+        }
+    }
+
+    void publish(Uint64 stepCounter) {
+        Game& g = replay ? playback.game : game;
+        Uint32 taken = impactsTaken.load(memory_order_acquire);
+        if (taken - impactBase <= impacts.size()) {
+            impacts.erase(impacts.begin(), impacts.begin() + (taken - impactBase));
+            impactBase = taken;
+        }
+        for (const Impact& impact : g.impacts) {
+            if (impacts.size() < (size_t)IMPACT_BUDGET) impacts.push_back(impact);
+        }
+        g.impacts.clear();
+
+        SimSnapshot& s = snapshots.writeSlot();
+        s.capture(g);
+        s.impacts = impacts;
+        s.impactBase = impactBase;
+        s.finished = replay && playback.done;
+        s.session = generation;
+        s.inputs = inputsApplied;
+        s.stepCounter = stepCounter;
+        snapshots.publish();
+        if (spectators) spectators->publish(replay ? playback.game : game);
+    }
+
+    void run() {
+        const Uint64 frequency = SDL_GetPerformanceFrequency();
+        const Uint64 tickLength = frequency / SIM_HZ;
+        Uint64 nextTick = SDL_GetPerformanceCounter();
+        while (!stopping) {
+            bool changed = false;
+            for (SimCommand c; commands.pop(c);) {
+                apply(c);
+                changed = true;
+            }
+
+            Uint64 now = SDL_GetPerformanceCounter();
+            int steps = 0;
+            if (running) {
+                PROFILE_SCOPE(PHASE_SIM);
+                for (; now >= nextTick && steps < MAX_CATCHUP_STEPS; steps++) {
+                    step();
+                    nextTick += tickLength;
+                }
+                // After a long stall, drop the backlog instead of spiralling further behind.
+                if (steps == MAX_CATCHUP_STEPS && now >= nextTick) nextTick = now + tickLength;
+            } else {
+                nextTick = now + tickLength;
+            }
+            if (steps || changed) publish(SDL_GetPerformanceCounter());
+
+            // Stopped, there is nothing to tick for: sleep until a command,
+            // a start or shutdown comes in, and count the next tick from then.
+            if (!running) {
+                unique_lock<mutex> lock(wakeLock);
+                wake.wait(lock, [this] { return commands.pending() || stopping || running; });
+                nextTick = SDL_GetPerformanceCounter() + tickLength;
+                continue;
+            }
+
+            now = SDL_GetPerformanceCounter();
+            Uint32 waitMs = nextTick > now ? (Uint32)((nextTick - now) * 1000 / frequency) : 0;
+            if (waitMs > 1) {
+                unique_lock<mutex> lock(wakeLock);
+                wake.wait_for(lock, chrono::milliseconds(waitMs - 1), [this] { return commands.pending() || stopping; });
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+};
+
+// Scripted stand-in for a human used by headless runs: wanders between random
+// points and drops a shield towards the closest bullet whenever it can.
+// Decisions come out as inputs so they can be recorded like a player's.
+struct HeadlessPilot {
+    Rng rng;
+    Uint32 nextWander = 0;
+
+    void reset(Uint64 seed) {
+        rng.reseed(seed ^ 0xA5A5A5A5A5A5A5A5ull);
+        nextWander = 0;
+    }
+
+    // Every half second of game time, however many ticks a step covers.
+    void drive(const Game& game, vector<ReplayEvent>& inputs) {
+        if (game.tick >= nextWander) {
+            nextWander = game.tick - game.tick % (SIM_HZ / 2) + SIM_HZ / 2;
+            int x = rng.range(SCREEN_WIDTH - 60);
+            int y = rng.range(SCREEN_HEIGHT - 60);
+            inputs.push_back(ReplayEvent{game.tick, REPLAY_TARGET, x, y, 0});
+        }
+        if (game.remainingCooldown() == 0 && !game.bullets.empty()) {
+            const BulletPool& bullets = game.bullets;
+            int closest = -1;
+            float best = 0;
+            for (int i = 0; i < bullets.count; i++) {
+                float dx = bullets.x[i] - game.player.x;
+                float dy = bullets.y[i] - game.player.y;
+                float d = dx * dx + dy * dy;
+                if (closest < 0 || d < best) {
+                    closest = i;
+                    best = d;
+                }
+            }
+            if (best < 150.0f * 150.0f) {
+                inputs.push_back(ReplayEvent{game.tick, REPLAY_SHIELD, (int)bullets.x[closest], (int)bullets.y[closest], 0});
+            }
+        }
+    }
+};
+
+const int BOT_DECISION_TICKS = 12;
+const int BOT_HORIZON_TICKS = 60;
+const int BOT_ROLLOUTS = 512;
+const int BOT_MOVES = 9;
+const int BOT_MOVE_DISTANCE = 120;
+
+// Autoplay by Monte-Carlo rollouts. Every BOT_DECISION_TICKS it packs the
+// game into a GameImage and scores each candidate action. An action is a
+// move target (stay, or BOT_MOVE_DISTANCE in one of eight directions), with
+// a shield at the nearest bullet added when one is ready. Each action gets
+// an equal share of the rollouts. A rollout unpacks the image into a
+// preallocated Game, reseeds it so the bullets still to come are a fresh
+// guess, applies the action and plays up to horizon ticks. The action with
+// the longest mean survival wins, and ties go to the cheaper action. Rollouts
+// run on the job pool in fixed chunks with their own seeds, so the choice
+// does not depend on the thread count. Games the image cannot hold, such as
+// bullet hell, fall back to HeadlessPilot.
+struct RolloutBot {
+    int rollouts = BOT_ROLLOUTS;
+    int horizon = BOT_HORIZON_TICKS;
+    Rng rng;
+    HeadlessPilot fallback;
+    GameImage root;
+    vector<Game> workers; // one per chunk, reused between decisions
+    vector<Uint64> survived; // per chunk
+    Uint64 rolloutsRun = 0;
+    double rolloutSeconds = 0;
+
+    struct Action {
+        int x, y;
+        bool shield;
+    };
+
+    void reset(Uint64 seed) {
+        rng.reseed(seed ^ 0x5A5A5A5A5A5A5A5Aull);
+        fallback.reset(seed);
+    }
+
+    void drive(const Game& game, vector<ReplayEvent>& inputs) {
+        if (game.tick % BOT_DECISION_TICKS != 0) return;
+        if (!root.pack(game)) {
+            fallback.drive(game, inputs);
+            return;
+        }
+
+        Action actions[BOT_MOVES * 2];
+        int count = 0;
+        int aimX = 0, aimY = 0;
+        bool canShield = game.remainingCooldown() == 0 && !game.bullets.empty() &&
+                         !(game.firstShieldUsed && game.now() - game.lastWall <= WALL_COOLDOWN_MS);
+        if (canShield) {
+            float best = -1;
+            for (int i = 0; i < game.bullets.count; i++) {
+                float dx = game.bullets.x[i] - game.player.x;
+                float dy = game.bullets.y[i] - game.player.y;
+                if (best < 0 || dx * dx + dy * dy < best) {
+                    best = dx * dx + dy * dy;
+                    aimX = (int)game.bullets.x[i];
+                    aimY = (int)game.bullets.y[i];
+                }
+            }
+        }
+        for (int shield = 0; shield <= (canShield ? 1 : 0); shield++) {
+            for (int m = 0; m < BOT_MOVES; m++) {
+                int x = game.player.rect.x, y = game.player.rect.y;
+                if (m > 0) {
+                    float angle = (m - 1) * 0.78539816f;
+                    x += (int)(cos(angle) * BOT_MOVE_DISTANCE);
+                    y += (int)(sin(angle) * BOT_MOVE_DISTANCE);
+                }
+                x = max(0, min(SCREEN_WIDTH - game.player.rect.w, x));
+                y = max(0, min(SCREEN_HEIGHT - game.player.rect.h, y));
+                actions[count++] = Action{x, y, shield != 0};
+            }
+        }
+
+        // Split each action's rollouts over enough chunks to keep every
+        // thread busy.
+        int perAction = max(1, rollouts / count);
+        int splits = min(perAction, max(1, (jobs.threads * 4 + count - 1) / count));
+        int chunks = count * splits;
+        if ((int)workers.size() < chunks) workers.resize(chunks);
+        survived.assign(chunks, 0);
+        Uint64 seed = rng.next();
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        jobs.parallelFor(chunks, [&](int c) {
+            const Action& action = actions[c / splits];
+            int split = c % splits;
+            Game& g = workers[c];
+            Uint64 total = 0;
+            for (int r = split; r < perAction; r += splits) {
+                root.unpack(g);
+                g.rng.reseed(seed + (Uint64)(c / splits) * 0x9E3779B97F4A7C15ull + r);
+                g.setTarget(action.x, action.y);
+                if (action.shield) g.placeShield(aimX, aimY);
+                int t = 0;
+                for (; t < horizon && !g.over; t++) g.step();
+                total += t;
+            }
+            survived[c] = total;
+        });
+        rolloutSeconds += (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        rolloutsRun += (Uint64)perAction * count;
+
+        int best = 0;
+        Uint64 bestTotal = 0;
+        for (int a = 0; a < count; a++) {
+            Uint64 total = 0;
+            for (int s = 0; s < splits; s++) total += survived[a * splits + s];
+            if (a == 0 || total > bestTotal) {
+                best = a;
+                bestTotal = total;
+            }
+        }
+        const Action& choice = actions[best];
+        if (choice.x != game.targetX || choice.y != game.targetY) {
+            inputs.push_back(ReplayEvent{game.tick, REPLAY_TARGET, choice.x, choice.y, 0});
+        }
+        if (choice.shield) inputs.push_back(ReplayEvent{game.tick, REPLAY_SHIELD, aimX, aimY, 0});
+    }
+};
+
+// --headless --verify a.rpl b.rpl ...: re-simulate replays at full speed and
+// check the scores they claim (--replay works the same way). The file list
+// runs up to the next option. Prints one line per file and exits non-zero if
+// any replay fails to load, was recorded with other bullet patterns, desyncs
+// or claims a score it did not earn.
+int runVerify(int argc, char* argv[]) {
+    int first = 1;
+    while (first < argc && strcmp(argv[first], "--verify") != 0 && strcmp(argv[first], "--replay") != 0) first++;
+    AssetLoader assets;
+    if (!loadPatterns(argc, argv, assets)) return 1;
+
+    jobs.start(threadsArg(findArg(argc, argv, "--threads")));
+    Replay replay;
+    ReplayPlayer player;
+    player.seekable = false;
+    int files = 0, rejected = 0;
+    Uint64 totalTicks = 0, checksum = 14695981039346656037ull;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = first + 1; i < argc && strncmp(argv[i], "--", 2) != 0; i++, files++) {
+        if (!replay.load(argv[i])) {
+            printf("%s load-failed\n", argv[i]);
+            rejected++;
+            continue;
+        }
+        if (replay.patternHash != patterns.hash) {
+            printf("%s PATTERNS-DIFFER\n", argv[i]);
+            rejected++;
+            continue;
+        }
+        player.start(replay);
+        while (player.advance()) {}
+        for (Uint32 ticks : player.sessionTicks) checksum = (checksum ^ ticks) * 1099511628211ull;
+        totalTicks += player.elapsed;
+        bool ok = !player.desynced && player.mismatches == 0;
+        if (!ok) rejected++;
+        printf("%s sessions=%d ticks=%llu %s\n", argv[i], (int)player.scores.size(), (unsigned long long)player.elapsed,
+               player.desynced ? "DESYNC" : player.mismatches ? "SCORE-MISMATCH" : "ok");
+    }
+    double elapsed = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    printf("replays=%d rejected=%d ticks=%llu elapsed_s=%.3f replays_per_min=%.0f\n", files, rejected,
+           (unsigned long long)totalTicks, elapsed, elapsed > 0 ? files * 60.0 / elapsed : 0.0);
+    printf("checksum=%016llx\n", (unsigned long long)checksum);
+    jobs.stop();
+    return rejected ? 1 : 0;
+}
+
+// --headless: run sessions back to back with no window, renderer, fonts or
+// audio, as fast as the CPU allows, and print a summary with a checksum that
+// changes whenever gameplay does. --record writes every session to one replay,
+// --patterns plays a different bullet pattern file.
+// --mode hell plays bullet hell on --threads workers (all cores by default);
+// add --god to keep the player alive and measure throughput at full density.
+// --bot plays with RolloutBot instead of the random pilot (--bot-rollouts per
+// decision, --bot-horizon ticks each) and reports rollout throughput.
+// --step-ticks N advances N ticks per step, for cheap batch evaluations.
+// Inputs are read once per step, so the pilot reacts later, but a step plays
+// out exactly as its ticks would one by one (see --step-check).
+// --spectate-check: a viewer in the same process. Every tick is encoded,
+// decoded and compared with the game bullet by bullet.
+struct SpectateCheck {
+    SpectatorEncoder encoder;
+    SpectatorView view;
+    vector<Uint8> packet;
+    vector<int> order;
+    Uint64 packets = 0, bytes = 0, keyframes = 0, keyBytes = 0, bad = 0;
+    float maxError = 0;
+
+    void step(const Game& game) {
+        bool key;
+        packet.clear();
+        if (!encoder.encode(game, packet, key)) return;
+        packets++;
+        bytes += packet.size();
+        if (key) {
+            keyframes++;
+            keyBytes += packet.size();
+        }
+
+        const BulletPool& pool = game.bullets;
+        bool ok = view.apply(packet.data(), packet.size()) && view.tick == game.tick && view.health == game.health &&
+                  view.shields.size() == game.shields.size() && (int)view.bullets.size() == pool.count;
+        order.resize(pool.count);
+        for (int i = 0; i < pool.count; i++) order[i] = i;
+        sort(order.begin(), order.end(), [&](int a, int b) { return pool.id[a] < pool.id[b]; });
+        for (int i = 0; ok && i < pool.count; i++) {
+            const SpectatorBullet& b = view.bullets[i];
+            int k = order[i];
+            float error = max(fabs(b.x / SPECTATE_UNITS - pool.x[k]), fabs(b.y / SPECTATE_UNITS - pool.y[k]));
+            maxError = max(maxError, error);
+            ok = b.id == pool.id[k] && error <= (SPECTATE_TOLERANCE + 1) / SPECTATE_UNITS;
         }
+        if (!ok) bad++;
     }
 
-    void render(SDL_Renderer* renderer) {
-        SDL_RenderCopy(renderer, tex, NULL, &rect);
+    void print() const {
+        Uint64 deltas = packets - keyframes;
+        printf("spectate packets=%llu bytes_per_packet=%.1f keyframes=%llu key_bytes=%.0f delta_bytes=%.1f max_error_px=%.3f bad=%llu\n",
+               (unsigned long long)packets, packets ? (double)bytes / packets : 0.0, (unsigned long long)keyframes,
+               keyframes ? (double)keyBytes / keyframes : 0.0, deltas ? (double)(bytes - keyBytes) / deltas : 0.0, maxError,
+               (unsigned long long)bad);
     }
 };
 
-struct Shield {
-    SDL_Rect rect;
-    Uint32 spawnTime;
+int runHeadless(int argc, char* argv[]) {
+    if (hasFlag(argc, argv, "--verify") || hasFlag(argc, argv, "--replay")) return runVerify(argc, argv);
+    AssetLoader assets;
+    assets.mount(PAK_FILE);
+    if (!loadPatterns(argc, argv, assets)) return 1;
 
-    Shield(int x, int y, bool horizontal) {
-        if (horizontal)
-            rect = {x - 50, y - 10, 100, 20};
-        else
-            rect = {x - 10, y - 50, 20, 100};
-        spawnTime = SDL_GetTicks();
+    Uint64 sessions = argU64(argc, argv, "--sessions", 1000);
+    Uint64 seed = argU64(argc, argv, "--seed", 1);
+    Uint64 maxTicks = argU64(argc, argv, "--max-seconds", 300) * SIM_HZ;
+    const char* modeName = findArg(argc, argv, "--mode");
+    GameMode mode = modeName && strcmp(modeName, "hell") == 0 ? MODE_BULLET_HELL : MODE_CLASSIC;
+    int stepTicks = (int)max((Uint64)1, argU64(argc, argv, "--step-ticks", 1));
+    if (stepTicks > 1 && findArg(argc, argv, "--record")) {
+        printf("--record needs --step-ticks 1; replays play back tick by tick\n");
+        return 1;
     }
+    jobs.start(threadsArg(findArg(argc, argv, "--threads")));
+
+    if (verifyCollideKernels(seed, 200, false)) return 1;
 
-    bool isExpired() {
-        return SDL_GetTicks() - spawnTime > 2000;
+    Game game;
+    HeadlessPilot pilot;
+    RolloutBot bot;
+    bool useBot = hasFlag(argc, argv, "--bot");
+    bot.rollouts = (int)argU64(argc, argv, "--bot-rollouts", BOT_ROLLOUTS);
+    bot.horizon = (int)argU64(argc, argv, "--bot-horizon", BOT_HORIZON_TICKS);
+    ReplayRecorder recorder;
+    recorder.start(findArg(argc, argv, "--record"), seed, mode);
+    SpectatorPublisher spectators;
+    const char* spectatePath = findArg(argc, argv, "--spectate-out");
+    if (spectatePath && !spectators.open(spectatePath)) return 1;
+    bool checkSpectating = hasFlag(argc, argv, "--spectate-check");
+    SpectateCheck spectateCheck;
+    vector<ReplayEvent> inputs;
+    Uint64 totalTicks = 0, bulletUpdates = 0, checksum = 14695981039346656037ull;
+    Uint32 minTicks = 0xFFFFFFFFu, maxSurvived = 0;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (Uint64 i = 0; i < sessions; i++) {
+        if (i > 0) recorder.add(ReplayEvent{game.tick, REPLAY_RESTART, mode, 0, seed + i});
+        game.reset(seed + i, mode);
+        game.invulnerable = hasFlag(argc, argv, "--god");
+        pilot.reset(seed + i);
+        bot.reset(seed + i);
+        while (!game.over && game.tick < maxTicks) {
+            inputs.clear();
+            if (useBot) {
+                bot.drive(game, inputs);
+            } else {
+                pilot.drive(game, inputs);
+            }
+            for (auto& input : inputs) {
+                recorder.add(input);
+                applyInput(game, input);
+            }
+            game.step(stepTicks);
+            bulletUpdates += game.bullets.count * (Uint64)stepTicks;
+            if (spectatePath) spectators.publish(game);
+            if (checkSpectating) spectateCheck.step(game);
+        }
+        if (game.over) recorder.add(ReplayEvent{game.tick, REPLAY_SCORE, 0, 0, (Uint64)game.survivalTime()});
+        totalTicks += game.tick;
+        minTicks = min(minTicks, game.tick);
+        maxSurvived = max(maxSurvived, game.tick);
+        checksum = (checksum ^ game.tick) * 1099511628211ull;
+        // Bullet hell sessions often end on the tick limit, so fold in the
+        // final bullets as well; classic checksums stay as they were.
+        if (mode == MODE_BULLET_HELL) {
+            checksum = (checksum ^ (Uint32)game.health) * 1099511628211ull;
+            for (int b = 0; b < game.bullets.count; b++) {
+                Uint32 bits[2];
+                memcpy(&bits[0], &game.bullets.x[b], 4);
+                memcpy(&bits[1], &game.bullets.y[b], 4);
+                checksum = (checksum ^ bits[0] ^ (Uint64)bits[1] << 32) * 1099511628211ull;
+            }
+        }
     }
+    recorder.add(ReplayEvent{game.tick, REPLAY_END, 0, 0, 0});
+    double elapsed = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
 
-    void render(SDL_Renderer* renderer, SDL_Texture* tex) {
-        SDL_RenderCopy(renderer, tex, NULL, &rect);
+    printf("sessions=%llu seed=%llu step_ticks=%d\n", (unsigned long long)sessions, (unsigned long long)seed, stepTicks);
+    printf("survival_s mean=%.3f min=%.3f max=%.3f\n",
+           sessions ? (double)totalTicks / sessions / SIM_HZ : 0.0,
+           sessions ? (double)minTicks / SIM_HZ : 0.0, (double)maxSurvived / SIM_HZ);
+    printf("ticks=%llu elapsed_s=%.3f sessions_per_s=%.1f ticks_per_s=%.0f\n", (unsigned long long)totalTicks, elapsed,
+           elapsed > 0 ? sessions / elapsed : 0.0, elapsed > 0 ? totalTicks / elapsed : 0.0);
+    if (mode == MODE_BULLET_HELL) {
+        printf("threads=%d bullet_updates=%llu bullet_updates_per_s=%.0f\n", jobs.threads, (unsigned long long)bulletUpdates,
+               elapsed > 0 ? bulletUpdates / elapsed : 0.0);
     }
-};
+    if (useBot) {
+        double perSecond = bot.rolloutSeconds > 0 ? bot.rolloutsRun / bot.rolloutSeconds : 0.0;
+        printf("threads=%d rollouts=%llu rollouts_per_s=%.0f rollouts_per_16ms=%.0f\n", jobs.threads,
+               (unsigned long long)bot.rolloutsRun, perSecond, perSecond * 0.016);
+    }
+    if (checkSpectating) spectateCheck.print();
+    printf("checksum=%016llx\n", (unsigned long long)checksum);
+    spectators.close();
+    jobs.stop();
+    return checkSpectating && spectateCheck.bad ? 1 : 0;
+}
 
-struct ScoreEntry {
-    string name;
-    int score;
+// --bench: micro-benchmarks of the simulation pieces and the highscore store
+// at 100, 10k and 1M entities, then whole frames drawn by the software
+// renderer on SDL's dummy video driver, so it runs on a box without a GPU or
+// display. Results are printed (or written to --bench-out) as JSON so runs
+// from different commits can be diffed. --bench-filter keeps only the
+// benchmarks whose name contains the given text.
+const double BENCH_MIN_MS = 200.0;
+const int BENCH_MAX_REPS = 1000;
+const int BENCH_SIZES[] = {100, 10000, 1000000};
+const int BENCH_FRAME_SIZES[] = {100, 1000, 10000};
+const int BENCH_PARTICLE_SIZES[] = {1000, 10000, 100000};
 
-    ScoreEntry(string n, int s) : name(n), score(s) {}
+struct BenchResult {
+    string name;
+    int n;
+    int reps;
+    double meanMs, minMs, medianMs, p99Ms;
 };
 
-bool checkCollision(SDL_Rect a, SDL_Rect b) {
-    return SDL_HasIntersection(&a, &b);
-}
-
-string intToString(int n) {
-    return to_string(n);
-}
+struct BenchRunner {
+    const char* filter = nullptr;
+    vector<BenchResult> results;
 
-vector<ScoreEntry> loadHighScores() {
-    vector<ScoreEntry> scores;
-    ifstream inFile("highscores.txt");
-    string name;
-    int score;
+    bool wanted(const string& name) const {
+        return !filter || name.find(filter) != string::npos;
+    }
 
-    if (inFile.is_open()) {
-        while (inFile >> name >> score) {
-            scores.push_back(ScoreEntry(name, score));
+    // Calls setup then times body, over and over, until BENCH_MIN_MS of body
+    // time has been spent (at least three runs). Setup is not timed.
+    template <class Setup, class Body>
+    void run(const string& name, int n, Setup setup, Body body) {
+        if (!wanted(name)) return;
+        vector<double> times;
+        double total = 0;
+        while ((total < BENCH_MIN_MS || times.size() < 3) && (int)times.size() < BENCH_MAX_REPS) {
+            setup();
+            Uint64 start = SDL_GetPerformanceCounter();
+            body();
+            double ms = millisecondsSince(start);
+            times.push_back(ms);
+            total += ms;
         }
-        inFile.close();
+        sort(times.begin(), times.end());
+        int reps = (int)times.size();
+        results.push_back(BenchResult{name, n, reps, total / reps, times[0], times[reps / 2],
+                                      times[min(reps - 1, (int)ceil(0.99 * reps) - 1)]});
+        fprintf(stderr, "%-24s n=%-8d %10.4f ms\n", name.c_str(), n, times[reps / 2]);
     }
 
-    if (scores.empty()) {
-        scores.push_back(ScoreEntry("Player1", 0));
-        scores.push_back(ScoreEntry("Player2", 0));
-        scores.push_back(ScoreEntry("Player3", 0));
-        scores.push_back(ScoreEntry("Player4", 0));
-        scores.push_back(ScoreEntry("Player5", 0));
+    template <class Body>
+    void run(const string& name, int n, Body body) {
+        run(name, n, [] {}, body);
     }
 
-    return scores;
-}
-
-void saveHighScores(const vector<ScoreEntry>& scores) {
-    ofstream outFile("highscores.txt");
-    if (outFile.is_open()) {
-        for (const auto& entry : scores) {
-            outFile << entry.name << " " << entry.score << endl;
+    void write(FILE* out) const {
+        fprintf(out, "{\n  \"simd\": \"%s\",\n  \"results\": [\n",
+                collideBatch == collideBatchAVX2 ? "avx2" : collideBatch == collideBatchSSE2 ? "sse2" : "scalar");
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            fprintf(out, "    {\"name\": \"%s\", \"n\": %d, \"reps\": %d, \"mean_ms\": %.6f, \"min_ms\": %.6f, "
+                         "\"median_ms\": %.6f, \"p99_ms\": %.6f, \"ns_per_entity\": %.3f}%s\n",
+                    r.name.c_str(), r.n, r.reps, r.meanMs, r.minMs, r.medianMs, r.p99Ms,
+                    r.medianMs * 1e6 / r.n, i + 1 < results.size() ? "," : "");
         }
-        outFile.close();
+        fprintf(out, "  ]\n}\n");
+    }
+};
+
+// Scenario generators. Bullets are scattered over the playfield with random
+// headings; shields are scattered the same way with staggered spawn times.
+void fillBullets(BulletPool& bullets, int n, Rng& rng) {
+    if (bullets.capacity < n) bullets.setCapacity(n);
+    bullets.clear();
+    for (int i = 0; i < n; i++) {
+        float speed = (5 + rng.range(5)) * 60.0f;
+        float angle = rng.range(6283) * 0.001f; // radians
+        bullets.spawn((float)rng.range(SCREEN_WIDTH), (float)rng.range(SCREEN_HEIGHT),
+                      cos(angle) * speed, sin(angle) * speed, rng.range(6));
     }
 }
 
-int getHighestScore() {
-    vector<ScoreEntry> scores = loadHighScores();
-    int highest = 0;
-    for (const auto& entry : scores) {
-        highest = max(highest, entry.score);
+void fillShields(vector<Shield>& shields, int n, Uint32 spawnWindow, Rng& rng) {
+    shields.clear();
+    for (int i = 0; i < n; i++) {
+        shields.push_back(Shield(rng.range(SCREEN_WIDTH), rng.range(SCREEN_HEIGHT), rng.range(2) == 0,
+                                 (Uint32)rng.range((int)spawnWindow)));
     }
-    return highest;
 }
 
-void updateHighScores(int newScore) {
-    vector<ScoreEntry> scores = loadHighScores();
-    bool updated = false;
-    for (auto& score : scores) {
-        if (newScore > score.score) {
-            score.name = "Player";
-            score.score = newScore;
-            updated = true;
-            break;
+void benchSimulation(BenchRunner& bench) {
+    Rng rng(1);
+    for (int n : BENCH_SIZES) {
+        // n emitters each firing one aimed shot from the edge.
+        BulletPool bullets(n);
+        vector<Emitter> emitters;
+        WaveEntry shot = {patterns.entry["aimed"], 1, 0, 0, ORIGIN_EDGE, 0, 0};
+        bench.run("pattern_emit", n, [&] {
+            bullets.clear();
+            emitters.clear();
+            for (int i = 0; i < n; i++) emitters.push_back(makeEmitter(shot, rng));
+        }, [&] { runEmitters(emitters, patterns, bullets, rng, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2); });
+
+        fillBullets(bullets, n, rng);
+        bench.run("bullet_update", n, [&] { bullets.move(SIM_DT); });
+
+        // Few shields take the batch kernel path, many take the grid.
+        Game game;
+        game.reset(1);
+        fillBullets(game.bullets, n, rng);
+        fillShields(game.shields, (int)BROADPHASE_MIN_SHIELDS, 1, rng);
+        bench.run("collision_batch", n, [&] { game.markHits(); });
+
+        // A bot rollout's copy: pack, then unpack into a reused Game.
+        if (n <= IMAGE_MAX_BULLETS) {
+            GameImage image;
+            Game clone;
+            bench.run("state_clone", n, [&] {
+                image.pack(game);
+                image.unpack(clone);
+            });
         }
+        fillShields(game.shields, 64, 1, rng);
+        bench.run("collision_grid", n, [&] { game.markHits(); });
+
+        // Half of the shields have outlived SHIELD_LIFETIME_MS by the tick the
+        // timers run to.
+        vector<Shield> shields;
+        fillShields(shields, n, SHIELD_LIFETIME_MS * 2, rng);
+        bench.run("shield_expiry", n, [&] {
+            game.shields.clear();
+            game.timers.clear(0);
+            for (auto& shield : shields) game.addShield(shield);
+        }, [&] {
+            game.runTimers(firstTickAt(SHIELD_LIFETIME_MS * 2));
+            game.expireShields();
+        });
+
+        // n timers spread over a minute; a quarter are cancelled, then the
+        // clock runs through the lot.
+        TimerWheel wheel;
+        vector<int> handles(n);
+        vector<TimerEvent> fired;
+        fired.reserve(n);
+        bench.run("timer_wheel", n, [&] {
+            wheel.clear(0);
+            fired.clear();
+        }, [&] {
+            for (int i = 0; i < n; i++) handles[i] = wheel.schedule(1 + rng.range(60 * SIM_HZ), 0, i);
+            for (int i = 0; i < n; i += 4) wheel.cancel(handles[i]);
+            wheel.advance(60 * SIM_HZ, fired);
+        });
     }
+}
+
+void benchHighscores(BenchRunner& bench) {
+    const string snapshot = "bench_highscores.txt", log = "bench_highscores.log";
+    for (int n : BENCH_SIZES) {
+        Rng rng(n);
+        auto writeSnapshot = [&] {
+            remove(log.c_str());
+            if (FILE* f = fopen(snapshot.c_str(), "w")) {
+                fprintf(f, "#seq 0\n");
+                for (int i = 0; i < n; i++) fprintf(f, "Player%d %d\n", rng.range(1000), rng.range(600));
+                fclose(f);
+            }
+        };
+
+        writeSnapshot();
+        bench.run("highscore_load", n, [&] {
+            Leaderboard board;
+            LeaderboardStore store;
+            store.open(snapshot, log, board);
+            store.close();
+        });
 
-    if (updated) {
-        sort(scores.begin(), scores.end(), [](const ScoreEntry& a, const ScoreEntry& b) {
-            return a.score > b.score;
+        // Appending n scores and closing the store folds them into the
+        // snapshot, which is the whole save path.
+        bench.run("highscore_save", n, writeSnapshot, [&] {
+            Leaderboard board;
+            LeaderboardStore store;
+            store.open(snapshot, log, board);
+            for (int i = 0; i < n; i++) {
+                board.insert("Bench", i);
+                store.append("Bench", i);
+            }
+            store.close();
         });
-        saveHighScores(scores);
     }
+    remove(snapshot.c_str());
+    remove(log.c_str());
+    remove((snapshot + ".tmp").c_str());
 }
 
-void renderText(SDL_Renderer* renderer, TTF_Font* font, const string& text, int x, int y, SDL_Color color = {255, 255, 255}) {
-    SDL_Surface* surface = TTF_RenderText_Solid(font, text.c_str(), color);
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_Rect rect = {x, y, surface->w, surface->h};
-    SDL_RenderCopy(renderer, texture, NULL, &rect);
+SDL_Texture* loadTexture(SDL_Renderer* renderer, const AssetLoader& assets, const char* name) {
+    SDL_RWops* rw = assets.open(name);
+    SDL_Surface* surface = rw ? IMG_Load_RW(rw, 1) : nullptr;
+    if (!surface) return nullptr;
+    SDL_Texture* tex = SDL_CreateTextureFromSurface(renderer, surface);
     SDL_FreeSurface(surface);
-    SDL_DestroyTexture(texture);
+    return tex;
 }
 
-void resetGame(Player& player, vector<Bullet>& bullets, vector<Shield>& shields, int& survivalTime, Uint32& lastWall,
-                bool& firstShieldUsed, Uint32& startTime, int& nextBulletTypeToSpawn, int& targetX, int& targetY,
-                int& currentMouseX, int& currentMouseY, SDL_Texture* playerTexRight) {
-    bullets.clear();
-    shields.clear();
-    player.rect = {SCREEN_WIDTH / 2 - 30, SCREEN_HEIGHT / 2 - 30, 60, 60};
-    player.tex = playerTexRight;
-    survivalTime = 0;
-    lastWall = 0;
-    firstShieldUsed = false;
-    startTime = SDL_GetTicks();
-    nextBulletTypeToSpawn = 0;
-    targetX = player.rect.x;
-    targetY = player.rect.y;
-    currentMouseX = targetX;
-    currentMouseY = targetY;
-}
-
-void spawnBullet(vector<Bullet>& bullets, int playerX, int playerY, int& nextBulletTypeToSpawn) {
-    int side = rand() % 4;
-    int x, y;
-    switch (side) {
-        case 0: x = rand() % SCREEN_WIDTH; y = SCREEN_HEIGHT + 20; break;
-        case 1: x = -20; y = rand() % SCREEN_HEIGHT; break;
-        case 2: x = rand() % SCREEN_WIDTH; y = -20; break;
-        case 3: x = SCREEN_WIDTH + 20; y = rand() % SCREEN_HEIGHT; break;
-    }
-
-    int texIndex;
-    if (nextBulletTypeToSpawn == 0) {
-        texIndex = side;
-        nextBulletTypeToSpawn = 1;
-    } else if (nextBulletTypeToSpawn == 1) {
-        texIndex = 4;
-        nextBulletTypeToSpawn = 2;
-    } else {
-        texIndex = 5;
-        nextBulletTypeToSpawn = 0;
+// A window with a renderer and every asset the game screen draws. Hidden and
+// software-rendered on SDL's dummy driver for the frame benchmarks and
+// --alloc-check; a real window for --spectate.
+struct RenderRig {
+    SDL_Window* window = nullptr;
+    SDL_Renderer* renderer = nullptr;
+    AssetLoader assets;
+    TTF_Font* font = nullptr;
+    TTF_Font* fontLarge = nullptr;
+    TTF_Font* fontMedium = nullptr;
+    SpriteAtlas sprites;
+    SpriteBatch batch;
+    SDL_Texture* bgTex = nullptr;
+    SDL_Texture* menuTex = nullptr;
+
+    bool open(const char* what, bool visible = false) {
+        if (!visible) SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+        if (SDL_Init(SDL_INIT_VIDEO) != 0 || !IMG_Init(IMG_INIT_PNG) || TTF_Init() != 0) {
+            fprintf(stderr, "%s skipped: %s\n", what, SDL_GetError());
+            return false;
+        }
+        if (visible) {
+            window = SDL_CreateWindow(what, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+            renderer = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC) : nullptr;
+        } else {
+            window = SDL_CreateWindow(what, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_HIDDEN);
+        }
+        if (window && !renderer) renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+        if (!renderer) {
+            fprintf(stderr, "%s skipped: %s\n", what, SDL_GetError());
+            if (window) SDL_DestroyWindow(window);
+            SDL_Quit();
+            return false;
+        }
+
+        assets.mount(PAK_FILE);
+        font = TTF_OpenFontRW(assets.open("arial.ttf"), 1, 24);
+        fontLarge = TTF_OpenFontRW(assets.open("arial.ttf"), 1, 72);
+        fontMedium = TTF_OpenFontRW(assets.open("arial.ttf"), 1, 36);
+        textCache.build(renderer, font);
+        textCache.build(renderer, fontLarge);
+        textCache.build(renderer, fontMedium);
+
+        const char* spriteFiles[SPRITE_COUNT] = {
+            "bullet1.1.png", "bullet1.2.png", "bullet1.3.png", "bullet1.4.png", "bullet2.png", "bullet3.png",
+            "wall.png", "player2.png", "player1.png"
+        };
+        SDL_Surface* spriteImages[SPRITE_COUNT];
+        for (int i = 0; i < SPRITE_COUNT; i++) {
+            SDL_RWops* rw = assets.open(spriteFiles[i]);
+            spriteImages[i] = rw ? IMG_Load_RW(rw, 1) : nullptr;
+        }
+        sprites.build(renderer, spriteImages);
+        batch.atlas = &sprites;
+        bgTex = loadTexture(renderer, assets, "background.png");
+        menuTex = loadTexture(renderer, assets, "menu.png");
+        return true;
     }
 
-    float dx = playerX - x;
-    float dy = playerY - y;
-    float len = sqrt(dx * dx + dy * dy);
-    float speed = 5 + rand() % 5;
-    bullets.emplace_back(x, y, dx / len * speed, dy / len * speed, texIndex);
-}
+    // One game frame as the main loop draws it.
+    void drawGame(const SimSnapshot& view) {
+        frameArena.reset();
+        SDL_RenderClear(renderer);
+        textCache.beginFrame();
+        renderGame(renderer, bgTex, batch, view, font, fontLarge, fontMedium, 0, PLAYING, 1.0f, false);
+        SDL_RenderPresent(renderer);
+    }
 
-void renderMenu(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& menuButtons, TTF_Font* font) {
-    SDL_RenderCopy(renderer, menuTex, NULL, NULL);
-    for (auto& button : menuButtons) {
-        button.render(renderer, font);
+    void close() {
+        SDL_DestroyTexture(bgTex);
+        SDL_DestroyTexture(menuTex);
+        textCache.clear();
+        TTF_CloseFont(font);
+        TTF_CloseFont(fontLarge);
+        TTF_CloseFont(fontMedium);
+        assets.close();
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        TTF_Quit();
+        IMG_Quit();
+        SDL_Quit();
     }
-}
+};
 
-void renderHowToPlay(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& backButtons,
-                     TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium) {
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+// Whole frames: simulation steps for one 60 Hz frame, a snapshot of the
+// result, then the game screen.
+// The pool is topped back up to n every frame and the player cannot die, so
+// each frame draws the same number of bullets.
+void benchFrames(BenchRunner& bench) {
+    RenderRig rig;
+    if (!rig.open("frame benchmarks")) return;
 
-    SDL_Color gold = {255, 215, 0};
-    renderText(renderer, fontLarge, "HOW TO PLAY", SCREEN_WIDTH / 2 - 200, 100, gold);
+    vector<Button> menuButtons = {
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 350, 200, 40, "PLAY GAME"),
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 300, 200, 40, "BULLET HELL"),
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 250, 200, 40, "HOW TO PLAY"),
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 200, 200, 40, "SETTINGS"),
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 150, 200, 40, "HIGHSCORE"),
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 100, 200, 40, "EXIT")
+    };
+    bench.run("frame_menu", 1, [&] {
+        SDL_RenderClear(rig.renderer);
+        textCache.beginFrame();
+        renderMenu(rig.renderer, rig.menuTex, menuButtons, rig.font);
+        SDL_RenderPresent(rig.renderer);
+    });
 
-    SDL_Color white = {255, 255, 255};
-    renderText(renderer, fontMedium, "CONTROLS:", SCREEN_WIDTH / 2 - 350, 200, white);
-    renderText(renderer, font, "RIGHT CLICK - Move player to cursor location", SCREEN_WIDTH / 2 - 350, 250);
-    renderText(renderer, font, "ENTER - Place shield in mouse direction (10 second cooldown)", SCREEN_WIDTH / 2 - 350, 300);
-    renderText(renderer, font, "ESC - Return to menu during gameplay", SCREEN_WIDTH / 2 - 350, 350);
+    Rng rng(7);
+    SimSnapshot view;
+    for (int n : BENCH_FRAME_SIZES) {
+        Game game;
+        game.reset(1);
+        game.bullets.setCapacity(n);
+        fillShields(game.shields, 4, 1, rng);
+        bench.run("frame_game", n, [&] {
+            while (game.bullets.count < n) {
+                game.bullets.spawn((float)rng.range(SCREEN_WIDTH), (float)rng.range(SCREEN_HEIGHT),
+                                   (float)(rng.range(600) - 300), (float)(rng.range(600) - 300), rng.range(6));
+            }
+        }, [&] {
+            for (int i = 0; i < SIM_HZ / TARGET_FPS; i++) {
+                game.step();
+                game.over = false;
+            }
+            view.capture(game);
+            rig.drawGame(view);
+        });
+    }
 
-    renderText(renderer, fontMedium, "GAMEPLAY:", SCREEN_WIDTH / 2 - 350, 420, white);
-    renderText(renderer, font, "- Dodge incoming bullets from all directions", SCREEN_WIDTH / 2 - 350, 470);
-    renderText(renderer, font, "- Use shields strategically to block bullets", SCREEN_WIDTH / 2 - 350, 520);
-    renderText(renderer, font, "- Survive as long as possible to achieve high score", SCREEN_WIDTH / 2 - 350, 570);
-    renderText(renderer, font, "- Different bullet types have different movement patterns", SCREEN_WIDTH / 2 - 350, 620);
+    // The largest frame again with the world drawn at reduced scale, as
+    // dynamic resolution does on a slow renderer.
+    if (resolution.enable(rig.renderer, RES_SOFTWARE_BUDGET_MS)) {
+        int n = BENCH_FRAME_SIZES[2];
+        Game game;
+        game.reset(1);
+        game.bullets.setCapacity(n);
+        fillShields(game.shields, 4, 1, rng);
+        for (int percent : {75, 50}) {
+            resolution.scale = percent / 100.0f;
+            bench.run("frame_game_scale" + to_string(percent), n, [&] {
+                while (game.bullets.count < n) {
+                    game.bullets.spawn((float)rng.range(SCREEN_WIDTH), (float)rng.range(SCREEN_HEIGHT),
+                                       (float)(rng.range(600) - 300), (float)(rng.range(600) - 300), rng.range(6));
+                }
+            }, [&] {
+                for (int i = 0; i < SIM_HZ / TARGET_FPS; i++) {
+                    game.step();
+                    game.over = false;
+                }
+                view.capture(game);
+                rig.drawGame(view);
+            });
+        }
+        resolution.destroy();
+    }
 
-    for (auto& button : backButtons) {
-        button.render(renderer, font);
+    // Particles alone: one frame's update, then building and submitting the
+    // quads. Lives are long enough that none die during the run.
+    for (int n : BENCH_PARTICLE_SIZES) {
+        ParticleSystem ps;
+        ps.init(n);
+        ps.count = n;
+        for (int i = 0; i < n; i++) {
+            float angle = rng.range(6283) * 0.001f;
+            ps.x[i] = (float)rng.range(SCREEN_WIDTH);
+            ps.y[i] = (float)rng.range(SCREEN_HEIGHT);
+            ps.vx[i] = cos(angle) * 200;
+            ps.vy[i] = sin(angle) * 200;
+            ps.life[i] = 1e6f;
+            ps.invLife[i] = 1e-6f;
+            ps.size[i] = 4;
+            ps.color[i] = BURST_STYLES[IMPACT_BLOCK].color;
+        }
+        bench.run("particle_update", n, [&] { ps.update(1.0f / TARGET_FPS); });
+        bench.run("particle_frame", n, [&] {
+            ps.update(1.0f / TARGET_FPS);
+            ps.render(rig.renderer);
+            SDL_RenderFlush(rig.renderer);
+        });
     }
+
+    rig.close();
 }
 
-void renderSettings(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& settingsButtons,
-                     TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium, int musicVolume, int soundVolume) {
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    SDL_Color gold = {255, 215, 0};
-    renderText(renderer, fontLarge, "SETTINGS", SCREEN_WIDTH / 2 - 150, 100, gold);
-    SDL_Color white = {255, 255, 255};
-    renderText(renderer, fontMedium, "Music Volume:", SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT / 2 - 150, white);
-    int musicPercentage = (musicVolume * 100) / MIX_MAX_VOLUME;
-    renderText(renderer, fontMedium, intToString(musicPercentage) + "%", SCREEN_WIDTH / 2 + 100, SCREEN_HEIGHT / 2 - 150);
-    for (auto& button : settingsButtons) {
-        button.render(renderer, font);
+int runBenchmarks(int argc, char* argv[]) {
+    BenchRunner bench;
+    bench.filter = findArg(argc, argv, "--bench-filter");
+    string error;
+    patterns.compile(DEFAULT_PATTERNS, error);
+    benchSimulation(bench);
+    benchHighscores(bench);
+    if (bench.wanted("frame_") || bench.wanted("particle_")) benchFrames(bench);
+
+    const char* outPath = findArg(argc, argv, "--bench-out");
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot write %s\n", outPath);
+        return 1;
     }
+    bench.write(out);
+    if (out != stdout) fclose(out);
+    return 0;
 }
 
-vector<Button> settingsButtons = {
-    Button(SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT / 2 - 100, 60, 60, "-10%"),
-    Button(SCREEN_WIDTH / 2 + 190, SCREEN_HEIGHT / 2 - 100, 60, 60, "+10%"),
-    Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 100, 200, 40, "BACK TO MENU")
-};
-
-void renderHighscore(SDL_Renderer* renderer, SDL_Texture* menuTex, vector<Button>& backButtons,
-                     TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium) {
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+// --step-check: plays --sessions (default 200) sessions from --seed tick by
+// tick with the random pilot, keeping its inputs, then plays each again at
+// every size in STEP_CHECK_TICKS with those inputs applied on the ticks they
+// were made, and compares how the sessions end: the tick, health and, for
+// one cut off by --max-seconds, the bullets and shields left. --mode as for
+// --headless. Exits 1 if any session ends differently.
+const int STEP_CHECK_TICKS[] = {4, 16};
 
-    SDL_Color gold = {255, 215, 0};
-    renderText(renderer, fontLarge, "HIGH SCORES", SCREEN_WIDTH / 2 - 200, 100, gold);
+// A digest of where a game stands, independent of the order its bullets
+// happen to be stored in.
+Uint64 gameDigest(const Game& game) {
+    Uint64 digest = (Uint64)game.tick << 32 ^ (Uint32)game.health ^ (Uint64)game.shields.size() << 24;
+    for (int i = 0; i < game.bullets.count; i++) {
+        Uint32 bits[2];
+        memcpy(&bits[0], &game.bullets.x[i], 4);
+        memcpy(&bits[1], &game.bullets.y[i], 4);
+        digest += ((Uint64)bits[0] << 32 | bits[1]) * 0x9E3779B97F4A7C15ull;
+    }
+    return digest;
+}
 
-    vector<ScoreEntry> scores = loadHighScores();
-    SDL_Color white = {255, 255, 255};
-    SDL_Color silver = {192, 192, 192};
-    SDL_Color bronze = {205, 127, 50};
+int runStepCheck(int argc, char* argv[]) {
+    AssetLoader assets;
+    assets.mount(PAK_FILE);
+    if (!loadPatterns(argc, argv, assets)) return 1;
 
-    renderText(renderer, fontMedium, "RANK", SCREEN_WIDTH / 2 - 350, 200, white);
-    renderText(renderer, fontMedium, "NAME", SCREEN_WIDTH / 2 - 150, 200, white);
-    renderText(renderer, fontMedium, "SCORE", SCREEN_WIDTH / 2 + 150, 200, white);
+    Uint64 sessions = argU64(argc, argv, "--sessions", 200);
+    Uint64 seed = argU64(argc, argv, "--seed", 1);
+    Uint32 maxTicks = (Uint32)(argU64(argc, argv, "--max-seconds", 300) * SIM_HZ);
+    const char* modeName = findArg(argc, argv, "--mode");
+    GameMode mode = modeName && strcmp(modeName, "hell") == 0 ? MODE_BULLET_HELL : MODE_CLASSIC;
+    jobs.start(threadsArg(findArg(argc, argv, "--threads")));
 
-    for (size_t i = 0; i < min(scores.size(), (size_t)10); i++) {
-        SDL_Color rankColor = white;
-        if (i == 0) rankColor = gold;
-        else if (i == 1) rankColor = silver;
-        else if (i == 2) rankColor = bronze;
+    const int sizes = (int)(sizeof(STEP_CHECK_TICKS) / sizeof(STEP_CHECK_TICKS[0]));
+    Game game;
+    HeadlessPilot pilot;
+    vector<ReplayEvent> inputs, script;
+    Uint64 totalTicks = 0, spanTicks[sizes] = {}, differ[sizes] = {};
+    double seconds = 0, spanSeconds[sizes] = {};
+    for (Uint64 s = 0; s < sessions; s++) {
+        game.reset(seed + s, mode);
+        pilot.reset(seed + s);
+        script.clear();
+        Uint64 start = SDL_GetPerformanceCounter();
+        while (!game.over && game.tick < maxTicks) {
+            inputs.clear();
+            pilot.drive(game, inputs);
+            for (auto& input : inputs) {
+                script.push_back(input);
+                applyInput(game, input);
+            }
+            game.step();
+        }
+        seconds += (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        totalTicks += game.tick;
+        bool over = game.over;
+        Uint64 digest = over ? (Uint64)game.tick << 32 ^ (Uint32)game.health : gameDigest(game);
 
-        renderText(renderer, font, "#" + intToString(i + 1), SCREEN_WIDTH / 2 - 350, 270 + i * 50, rankColor);
-        renderText(renderer, font, scores[i].name, SCREEN_WIDTH / 2 - 150, 270 + i * 50, rankColor);
-        renderText(renderer, font, intToString(scores[i].score), SCREEN_WIDTH / 2 + 150, 270 + i * 50, rankColor);
+        for (int k = 0; k < sizes; k++) {
+            game.reset(seed + s, mode);
+            size_t next = 0;
+            start = SDL_GetPerformanceCounter();
+            while (!game.over && game.tick < maxTicks) {
+                while (next < script.size() && script[next].tick == game.tick) applyInput(game, script[next++]);
+                Uint32 until = next < script.size() ? min(script[next].tick, maxTicks) : maxTicks;
+                game.step((int)min((Uint32)STEP_CHECK_TICKS[k], until - game.tick));
+            }
+            spanSeconds[k] += (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+            spanTicks[k] += game.tick;
+            Uint64 got = game.over ? (Uint64)game.tick << 32 ^ (Uint32)game.health : gameDigest(game);
+            if (game.over != over || got != digest) {
+                if (!differ[k]) {
+                    printf("seed %llu at %d ticks per step: ends on tick %u (%s), tick by tick on %u (%s)\n",
+                           (unsigned long long)(seed + s), STEP_CHECK_TICKS[k], game.tick, game.over ? "over" : "cut off",
+                           (Uint32)(digest >> 32), over ? "over" : "cut off");
+                }
+                differ[k]++;
+            }
+        }
     }
 
-    for (auto& button : backButtons) {
-        button.render(renderer, font);
+    printf("sessions=%llu seed=%llu\n", (unsigned long long)sessions, (unsigned long long)seed);
+    printf("step_ticks=1 survival_s mean=%.3f elapsed_s=%.3f\n", sessions ? (double)totalTicks / sessions / SIM_HZ : 0.0,
+           seconds);
+    int failed = 0;
+    for (int k = 0; k < sizes; k++) {
+        printf("step_ticks=%d survival_s mean=%.3f elapsed_s=%.3f differ=%llu\n", STEP_CHECK_TICKS[k],
+               sessions ? (double)spanTicks[k] / sessions / SIM_HZ : 0.0, spanSeconds[k], (unsigned long long)differ[k]);
+        if (differ[k]) failed = 1;
     }
+    jobs.stop();
+    return failed;
 }
 
-void renderGame(SDL_Renderer* renderer, SDL_Texture* bgTex, SDL_Texture* wallTex, vector<Shield>& shields,
-                vector<Bullet>& bullets, SDL_Texture* bulletTextures[6], Player& player,
-                TTF_Font* font, TTF_Font* fontLarge, TTF_Font* fontMedium,
-                int survivalTime, int highScore, int remainingCooldown, GameState gameState) {
-    SDL_RenderCopy(renderer, bgTex, NULL, NULL);
+// --verify-kernels: every SIMD collision kernel the CPU supports against
+// the scalar reference, over --rounds (default 5000) random batches from
+// --seed. Exits 1 if any kernel disagrees.
+int runKernelCheck(int argc, char* argv[]) {
+    Uint64 seed = argU64(argc, argv, "--seed", 1);
+    int rounds = (int)argU64(argc, argv, "--rounds", 5000);
+    return verifyCollideKernels(seed, rounds, true) ? 1 : 0;
+}
 
-    for (auto& shield : shields) {
-        shield.render(renderer, wallTex);
+// --alloc-check: plays classic and bullet hell offscreen, stepping, taking
+// snapshots and drawing exactly as the main loop does, and fails if any frame
+// after the warm-up touches the heap. Prints where allocations happened.
+const int ALLOC_CHECK_WARMUP_FRAMES = 600;
+const int ALLOC_CHECK_FRAMES = 1800;
+
+void printAllocCounts(const char* label, const AllocCounts& c) {
+    printf("%-14s %8llu allocs %10llu bytes", label, (unsigned long long)c.totalCount(), (unsigned long long)c.totalBytes());
+    for (int p = 0; p <= PHASE_COUNT; p++) {
+        if (c.count[p]) printf("  %s %llu", p < PHASE_COUNT ? PHASE_NAMES[p] : ALLOC_OTHER_NAME, (unsigned long long)c.count[p]);
     }
+    printf("\n");
+}
+
+int runAllocCheck(int argc, char* argv[]) {
+    trackSdlAllocations();
+    RenderRig rig;
+    if (!rig.open("alloc check")) return 1;
+    loadPatterns(argc, argv, rig.assets);
+    particles.init();
+
+    int failures = 0;
+    for (GameMode mode : {MODE_CLASSIC, MODE_BULLET_HELL}) {
+        Game game;
+        SimSnapshot view;
+        HeadlessPilot pilot;
+        vector<ReplayEvent> inputs;
+        inputs.reserve(8);
+        Uint64 seed = 1;
+        game.reset(seed, mode);
+        pilot.reset(seed);
+        game.invulnerable = mode == MODE_BULLET_HELL;
 
-    for (auto& b : bullets) {
-        b.render(renderer, bulletTextures);
+        AllocCounts steady = {};
+        int dirtyFrames = 0, growthFrames = 0;
+        for (int frame = 0; frame < ALLOC_CHECK_WARMUP_FRAMES + ALLOC_CHECK_FRAMES; frame++) {
+            AllocCounts before = allocStats.read();
+            int capacity = game.bullets.capacity;
+            for (int i = 0; i < SIM_HZ / TARGET_FPS; i++) {
+                inputs.clear();
+                pilot.drive(game, inputs);
+                for (auto& input : inputs) applyInput(game, input);
+                game.step();
+                for (const Impact& impact : game.impacts) particles.burst(impact);
+                game.impacts.clear();
+                if (game.over) {
+                    game.reset(++seed, mode);
+                    pilot.reset(seed);
+                }
+            }
+            particles.update(1.0f / TARGET_FPS);
+            view.capture(game);
+            rig.drawGame(view);
+            if (frame == ALLOC_CHECK_WARMUP_FRAMES - 1) printAllocCounts(mode == MODE_CLASSIC ? "classic warmup" : "hell warmup", allocStats.read());
+            if (frame < ALLOC_CHECK_WARMUP_FRAMES) continue;
+
+            // A bullet count past its high-water mark grows the pool (and the
+            // buffers sized to it); that is expected until the count levels off.
+            AllocCounts c = allocStats.since(before);
+            if (game.bullets.capacity > capacity) {
+                growthFrames++;
+                continue;
+            }
+            if (c.totalCount()) dirtyFrames++;
+            for (int p = 0; p <= PHASE_COUNT; p++) {
+                steady.count[p] += c.count[p];
+                steady.bytes[p] += c.bytes[p];
+            }
+        }
+        printAllocCounts(mode == MODE_CLASSIC ? "classic steady" : "hell steady", steady);
+        printf("%-14s %d of %d frames allocated, %d grew the bullet pool\n", "", dirtyFrames, ALLOC_CHECK_FRAMES, growthFrames);
+        if (dirtyFrames) failures++;
+        particles.clear();
     }
 
-    player.render(renderer);
+    rig.close();
+    return failures ? 1 : 0;
+}
 
-    SDL_Color white = {255, 255, 255};
-    string info = "Time: " + intToString(survivalTime) + "  High Score: " +
-    intToString(highScore);
-    renderText(renderer, font, info, 10, 10);
+// --spectate <file>: a window following a game started with --spectate-out
+// <file>. Each frame decodes whatever has arrived and draws the newest state,
+// so it keeps its own frame rate however fast the game ticks. It waits for
+// the stream if the game is not running yet and picks it up again when the
+// game restarts it.
+int runSpectator(int argc, char* argv[]) {
+    const char* path = findArg(argc, argv, "--spectate");
+    if (!path) {
+        printf("--spectate needs the file given to --spectate-out\n");
+        return 1;
+    }
+    RenderRig rig;
+    if (!rig.open("LOL SIMULATOR - spectator", true)) return 1;
 
-    SDL_Color cooldownColor = (remainingCooldown > 0) ? SDL_Color{255, 150, 0} : SDL_Color{0, 255, 0};
-    string cooldownText = "Shield Cooldown: " + intToString(remainingCooldown) + "s";
-    renderText(renderer, font, cooldownText, 10, 50, cooldownColor);
+    SpectateRing ring;
+    SpectatorView view;
+    SimSnapshot snapshot;
+    vector<Uint8> packet;
+    Uint32 lastAttach = 0;
+    const Uint64 frameLength = SDL_GetPerformanceFrequency() / TARGET_FPS;
+    bool quit = false;
+    while (!quit) {
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        for (SDL_Event e; SDL_PollEvent(&e);) {
+            if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)) quit = true;
+        }
+        if (!ring.base && (lastAttach == 0 || SDL_GetTicks() - lastAttach >= 1000)) {
+            lastAttach = SDL_GetTicks();
+            ring.attach(path);
+        }
+        // A packet that does not decode leaves the view waiting for the next keyframe.
+        while (ring.base && ring.read(packet)) {
+            if (!view.apply(packet.data(), packet.size())) view.valid = false;
+        }
 
-    if (gameState == GAME_OVER) {
-        SDL_Color red = {255, 0, 0};
-        renderText(renderer, fontLarge, "GAME OVER", SCREEN_WIDTH / 2 - 200, SCREEN_HEIGHT / 2 - 100, red);
-        renderText(renderer, fontMedium, "ENTER to restart - ESC for menu", SCREEN_WIDTH / 2 - 300, SCREEN_HEIGHT / 2);
+        frameArena.reset();
+        SDL_SetRenderDrawColor(rig.renderer, 0, 0, 0, 255);
+        SDL_RenderClear(rig.renderer);
+        textCache.beginFrame();
+        if (view.valid) {
+            view.fill(snapshot);
+            renderGame(rig.renderer, rig.bgTex, rig.batch, snapshot, rig.font, rig.fontLarge, rig.fontMedium, 0, PLAYING, 1.0f, false);
+            if (snapshot.over) renderText(rig.renderer, rig.fontLarge, "GAME OVER", SCREEN_WIDTH / 2 - 200, SCREEN_HEIGHT / 2 - 100, SDL_Color{255, 0, 0});
+        } else {
+            renderText(rig.renderer, rig.fontMedium, ring.base ? "Waiting for a keyframe..." : "Waiting for the game...",
+                       SCREEN_WIDTH / 2 - 250, SCREEN_HEIGHT / 2);
+        }
+        SDL_RenderPresent(rig.renderer);
+
+        // Without vsync, hold to TARGET_FPS rather than spin.
+        Uint64 spent = SDL_GetPerformanceCounter() - frameStart;
+        if (spent < frameLength) SDL_Delay((Uint32)((frameLength - spent) * 1000 / SDL_GetPerformanceFrequency()));
     }
+
+    ring.close();
+    rig.close();
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
-    srand(time(nullptr));
+    if (hasFlag(argc, argv, "--alloc-check")) {
+        return runAllocCheck(argc, argv);
+    }
+    if (hasFlag(argc, argv, "--verify-kernels")) {
+        return runKernelCheck(argc, argv);
+    }
+    if (hasFlag(argc, argv, "--step-check")) {
+        return runStepCheck(argc, argv);
+    }
+    if (hasFlag(argc, argv, "--headless")) {
+        return runHeadless(argc, argv);
+    }
+    if (hasFlag(argc, argv, "--spectate")) {
+        return runSpectator(argc, argv);
+    }
+    if (hasFlag(argc, argv, "--bench")) {
+        return runBenchmarks(argc, argv);
+    }
+    if (hasFlag(argc, argv, "--pack")) {
+        return runPacker(argc, argv);
+    }
+    Uint64 startupBegin = SDL_GetPerformanceCounter();
 
+    trackSdlAllocations();
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
     IMG_Init(IMG_INIT_PNG);
     TTF_Init();
-    Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048);
+    int audioFrames = openAudio(findArg(argc, argv, "--audio-latency") ? findArg(argc, argv, "--audio-latency") : "low");
+    if (audioFrames) SDL_Log("audio buffer %d frames (%.1f ms)", audioFrames, audioFrames * 1000.0 / AUDIO_RATE);
 
     SDL_Window* window = SDL_CreateWindow("LOL SIMULATOR", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-
-    TTF_Font* font = TTF_OpenFont("arial.ttf", 24);
-    TTF_Font* fontLarge = TTF_OpenFont("arial.ttf", 72);
-    TTF_Font* fontMedium = TTF_OpenFont("arial.ttf", 36);
-
-    SDL_Texture* bgTex = IMG_LoadTexture(renderer, "background.png");
-    SDL_Texture* menuTex = IMG_LoadTexture(renderer, "menu.png");
-    SDL_Texture* wallTex = IMG_LoadTexture(renderer, "wall.png");
-    SDL_Texture* playerTexLeft = IMG_LoadTexture(renderer, "player2.png");
-    SDL_Texture* playerTexRight = IMG_LoadTexture(renderer, "player1.png");
-
-    SDL_Texture* bulletTextures[6];
-    bulletTextures[0] = IMG_LoadTexture(renderer, "bullet1.1.png");
-    bulletTextures[1] = IMG_LoadTexture(renderer, "bullet1.2.png");
-    bulletTextures[2] = IMG_LoadTexture(renderer, "bullet1.3.png");
-    bulletTextures[3] = IMG_LoadTexture(renderer, "bullet1.4.png");
-    bulletTextures[4] = IMG_LoadTexture(renderer, "bullet2.png");
-    bulletTextures[5] = IMG_LoadTexture(renderer, "bullet3.png");
-
-    Mix_Music* bgMusic = Mix_LoadMUS("background.wav");
-    Mix_Chunk* explosionSound = Mix_LoadWAV("explosion.wav");
-    Mix_Chunk* buttonClickSound = Mix_LoadWAV("click.wav");
+    // --software skips the GPU; without one SDL falls back to software anyway.
+    SDL_Renderer* renderer = nullptr;
+    if (!hasFlag(argc, argv, "--software")) renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!renderer) {
+        if (!hasFlag(argc, argv, "--software")) SDL_Log("no accelerated renderer (%s), using software", SDL_GetError());
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+    SDL_RendererInfo rendererInfo;
+    SDL_GetRendererInfo(renderer, &rendererInfo);
+    bool vsync = (rendererInfo.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+
+    // --render-budget <ms> turns on dynamic resolution; it is on by default
+    // for the software renderer, which pays for every pixel on the CPU.
+    float renderBudget = (rendererInfo.flags & SDL_RENDERER_SOFTWARE) ? RES_SOFTWARE_BUDGET_MS : 0;
+    if (const char* arg = findArg(argc, argv, "--render-budget")) renderBudget = (float)atof(arg);
+    if (renderBudget > 0 && resolution.enable(renderer, renderBudget)) {
+        SDL_Log("dynamic resolution: %.1f ms budget on %s", renderBudget, rendererInfo.name);
+    }
+
+    AssetLoader assets;
+    assets.mount(PAK_FILE);
+    if (!loadPatterns(argc, argv, assets)) return 1;
+
+    // Images decode on worker threads while fonts and sounds load here.
+    // Sprite images come first, in SpriteId order.
+    vector<string> imageFiles = {
+        "bullet1.1.png", "bullet1.2.png", "bullet1.3.png", "bullet1.4.png", "bullet2.png", "bullet3.png",
+        "wall.png", "player2.png", "player1.png", "background.png", "menu.png"
+    };
+    ImageDecoder images;
+    images.start(assets, imageFiles);
+
+    Uint64 loadStart = SDL_GetPerformanceCounter();
+    TTF_Font* font = TTF_OpenFontRW(assets.open("arial.ttf"), 1, 24);
+    TTF_Font* fontLarge = TTF_OpenFontRW(assets.open("arial.ttf"), 1, 72);
+    TTF_Font* fontMedium = TTF_OpenFontRW(assets.open("arial.ttf"), 1, 36);
+    SDL_Log("asset %-16s %8.2f ms", "arial.ttf", millisecondsSince(loadStart));
+
+    loadStart = SDL_GetPerformanceCounter();
+    SDL_RWops* musicData = assets.open("background.wav");
+    Mix_Music* bgMusic = musicData ? Mix_LoadMUS_RW(musicData, 1) : nullptr;
+    SDL_Log("asset %-16s %8.2f ms", "background.wav", millisecondsSince(loadStart));
+    SfxBank sfx;
+    sfx.load(assets);
+
+    loadStart = SDL_GetPerformanceCounter();
+    textCache.build(renderer, font);
+    textCache.build(renderer, fontLarge);
+    textCache.build(renderer, fontMedium);
+    SDL_Log("asset %-16s %8.2f ms", "glyph atlases", millisecondsSince(loadStart));
+    particles.init();
+
+    images.finish();
+    for (auto& job : images.jobs) {
+        SDL_Log("asset %-16s %8.2f ms decode", job.name.c_str(), job.ms);
+    }
+
+    loadStart = SDL_GetPerformanceCounter();
+    SDL_Surface* bgImage = images.take(SPRITE_COUNT);
+    SDL_Surface* menuImage = images.take(SPRITE_COUNT + 1);
+    SDL_Texture* bgTex = SDL_CreateTextureFromSurface(renderer, bgImage);
+    SDL_Texture* menuTex = SDL_CreateTextureFromSurface(renderer, menuImage);
+    SDL_FreeSurface(bgImage);
+    SDL_FreeSurface(menuImage);
+
+    SDL_Surface* spriteImages[SPRITE_COUNT];
+    for (int i = 0; i < SPRITE_COUNT; i++) spriteImages[i] = images.take(i);
+    SpriteAtlas sprites;
+    sprites.build(renderer, spriteImages);
+    SpriteBatch spriteBatch;
+    spriteBatch.atlas = &sprites;
+    bool showRenderStats = false;
+    SDL_Log("asset %-16s %8.2f ms", "texture upload", millisecondsSince(loadStart));
+    SDL_Log("startup took %.2f ms", millisecondsSince(startupBegin));
 
     int musicVolume = MIX_MAX_VOLUME;
     int soundVolume = MIX_MAX_VOLUME;
     Mix_VolumeMusic(musicVolume);
-    Mix_Volume(-1, soundVolume);
+    sfx.volume = soundVolume;
 
     vector<Button> menuButtons = {
-        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 300, 200, 40, "PLAY GAME"),
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 350, 200, 40, "PLAY GAME"),
+        Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 300, 200, 40, "BULLET HELL"),
         Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 250, 200, 40, "HOW TO PLAY"),
         Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 200, 200, 40, "SETTINGS"),
         Button(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT - 150, 200, 40, "HIGHSCORE"),
@@ -427,56 +6324,133 @@ int main(int argc, char* argv[]) {
 
     Mix_PlayMusic(bgMusic, -1);
 
-    Player player;
-    player.rect = {SCREEN_WIDTH / 2 - 30, SCREEN_HEIGHT / 2 - 30, 60, 60};
-    player.tex = playerTexRight;
+    Rng sessionSeeds(argU64(argc, argv, "--seed", (Uint64)time(nullptr)));
+    GameState gameState = MENU;
 
-    vector<Bullet> bullets;
-    vector<Shield> shields;
+    // The simulation runs on its own thread; everything the player does to it
+    // goes through input(), and the sim records it when --record is given.
+    // --replay shows a recorded run instead of taking input; Left/Right seek
+    // 10 seconds and ENTER plays it again.
+    Replay replay;
+    const char* replayPath = findArg(argc, argv, "--replay");
+    bool replaying = replayPath && replay.load(replayPath);
+    if (replayPath && !replaying) SDL_Log("Could not load replay %s", replayPath);
+    if (replaying && replay.patternHash != patterns.hash) SDL_Log("%s was recorded with other bullet patterns and will not play back as it was", replayPath);
+    if (replaying) gameState = PLAYING;
 
-    GameState gameState = MENU;
+    jobs.start(threadsArg(findArg(argc, argv, "--threads")));
+    GameMode mode = MODE_CLASSIC;
+    SimThread sim;
+    SpectatorPublisher spectators;
+    if (const char* path = findArg(argc, argv, "--spectate-out")) {
+        if (spectators.open(path)) sim.spectators = &spectators;
+    }
+    sim.start(sessionSeeds.next(), findArg(argc, argv, "--record"), replaying ? &replay : nullptr);
+    Uint32 generation = 0;
+    // eventMs is the SDL timestamp of the event behind the input, for the
+    // latency meter.
+    auto input = [&](const ReplayEvent& e, Uint32 eventMs) {
+        Uint32 seq = inputLatency.add(eventMs);
+        sim.send(SimCommand{SIM_INPUT, e, 0});
+        if (e.type == REPLAY_RESTART) generation++;
+        return seq;
+    };
 
-    int targetX = SCREEN_WIDTH / 2, targetY = SCREEN_HEIGHT / 2;
-    int survivalTime = 0;
-    int highScore = getHighestScore();
-    Uint32 lastSpawn = 0, spawnDelay = 500;
-    Uint32 startTime = 0;
-    Uint32 wallCooldown = 10000, lastWall = 0;
-    bool firstShieldUsed = false;
-    int remainingCooldown = 0;
-    int nextBulletTypeToSpawn = 0;
+    Leaderboard leaderboard;
+    LeaderboardStore scoreStore;
+    scoreStore.open("highscores.txt", "highscores.log", leaderboard);
+    if (leaderboard.size() == 0) {
+        leaderboard.insert("Player1", 0);
+        leaderboard.insert("Player2", 0);
+        leaderboard.insert("Player3", 0);
+        leaderboard.insert("Player4", 0);
+        leaderboard.insert("Player5", 0);
+    }
+    int highScore = leaderboard.highest();
     int currentMouseX = SCREEN_WIDTH / 2;
     int currentMouseY = SCREEN_HEIGHT / 2;
+    int targetX = PLAYER_START_X, targetY = PLAYER_START_Y;
+    // --late-latch reads mouse input once more right before the game is
+    // drawn, sends it on and marks the move target in that same frame.
+    bool lateLatch = hasFlag(argc, argv, "--late-latch");
 
     SDL_Event e;
     bool quit = false;
+    ScreenCache screens;
+    Uint32 heardSession = ~0u;
+    int heardHealth = 0;
+    Uint32 impactsShown = 0;
+    Uint64 particleClock = SDL_GetPerformanceCounter();
+    GameState drawnState = GAME_STATE_COUNT;
+    bool redraw = true;
+
+#ifdef GAME_PROFILER
+    profiler.enabled = true;
+    if (const char* path = findArg(argc, argv, "--profile-csv")) profiler.openCsv(path);
+    if (const char* path = findArg(argc, argv, "--profile-trace")) profiler.openTrace(path);
+#endif
+
+    const Uint64 perfFrequency = SDL_GetPerformanceFrequency();
+    const Uint64 frameBudget = perfFrequency / TARGET_FPS;
+    Uint64 nextFrame = 0;
 
     while (!quit) {
+        // Block here while a static screen is up. The event stays queued
+        // for the loop below.
+        if (gameState != PLAYING && !redraw) SDL_WaitEventTimeout(nullptr, IDLE_WAIT_MS);
+
+        // Without vsync, wait out the frame budget here rather than after
+        // presenting, so input is read just before the frame that shows it.
+        // Sleep most of the wait and spin the last couple of milliseconds.
+        if (!vsync && (gameState == PLAYING || particles.count)) {
+            Uint64 now = SDL_GetPerformanceCounter();
+            if (now < nextFrame) {
+                Uint32 sleepMs = (Uint32)((nextFrame - now) * 1000 / perfFrequency);
+                if (sleepMs > 2) SDL_Delay(sleepMs - 2);
+                while (SDL_GetPerformanceCounter() < nextFrame) {}
+            }
+        }
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        nextFrame = frameStart + frameBudget;
+        AllocCounts frameAllocStart = allocStats.read();
+        frameArena.reset();
+#ifdef GAME_PROFILER
+        profiler.beginFrame();
+#endif
+
+        PROFILE_BEGIN(eventsScope, PHASE_EVENTS);
         while (SDL_PollEvent(&e)) {
+            // Nothing outside PLAYING follows the mouse; anything else may
+            // change or uncover what is on screen.
+            if (e.type != SDL_MOUSEMOTION) redraw = true;
+            if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) screens.invalidateAll();
             if (e.type == SDL_QUIT) {
                 quit = true;
             } else if (e.type == SDL_MOUSEMOTION) {
-                SDL_GetMouseState(&currentMouseX, &currentMouseY);
+                currentMouseX = e.motion.x;
+                currentMouseY = e.motion.y;
             } else if (e.type == SDL_MOUSEBUTTONDOWN) {
-                int mouseX, mouseY;
-                SDL_GetMouseState(&mouseX, &mouseY);
+                // Where the click happened, not where the mouse is by now.
+                int mouseX = e.button.x, mouseY = e.button.y;
 
                 if (gameState == MENU) {
                     for (size_t i = 0; i < menuButtons.size(); i++) {
                         if (menuButtons[i].isMouseOver(mouseX, mouseY)) {
-                            if (buttonClickSound) Mix_PlayChannel(-1, buttonClickSound, 0);
+                            sfx.play(SFX_CLICK);
 
-                            if (i == 0) {
+                            if (i <= 1) {
                                 gameState = PLAYING;
-                                resetGame(player, bullets, shields, survivalTime, lastWall, firstShieldUsed, startTime,
-                                          nextBulletTypeToSpawn, targetX, targetY, currentMouseX, currentMouseY, playerTexRight);
-                            } else if (i == 1) {
-                                gameState = HOW_TO_PLAY;
+                                mode = i == 0 ? MODE_CLASSIC : MODE_BULLET_HELL;
+                                input(ReplayEvent{0, REPLAY_RESTART, mode, 0, sessionSeeds.next()}, e.common.timestamp);
+                                currentMouseX = targetX = PLAYER_START_X;
+                                currentMouseY = targetY = PLAYER_START_Y;
                             } else if (i == 2) {
-                                gameState = SETTINGS;
+                                gameState = HOW_TO_PLAY;
                             } else if (i == 3) {
-                                gameState = HIGHSCORE;
+                                gameState = SETTINGS;
                             } else if (i == 4) {
+                                gameState = HIGHSCORE;
+                            } else if (i == 5) {
                                 quit = true;
                             }
                             break;
@@ -485,7 +6459,7 @@ int main(int argc, char* argv[]) {
                 } else if (gameState == HOW_TO_PLAY || gameState == HIGHSCORE) {
                     for (auto& button : backButtons) {
                         if (button.isMouseOver(mouseX, mouseY)) {
-                            if (buttonClickSound) Mix_PlayChannel(-1, buttonClickSound, 0);
+                            sfx.play(SFX_CLICK);
                             gameState = MENU;
                             break;
                         }
@@ -493,142 +6467,233 @@ int main(int argc, char* argv[]) {
                 } else if (gameState == SETTINGS) {
                     for (size_t i = 0; i < settingsButtons.size(); i++) {
                         if (settingsButtons[i].isMouseOver(mouseX, mouseY)) {
-                            if (buttonClickSound) Mix_PlayChannel(-1, buttonClickSound, 0);
+                            sfx.play(SFX_CLICK);
 
                             if (i == 0) { // Nt "-10%"
                                 musicVolume = max(0, musicVolume - MIX_MAX_VOLUME / 10);
                                 Mix_VolumeMusic(musicVolume);
+                                screens.invalidate(SETTINGS);
                             } else if (i == 1) { // Nt "+10%"
                                 musicVolume = min(MIX_MAX_VOLUME, musicVolume + MIX_MAX_VOLUME / 10);
                                 Mix_VolumeMusic(musicVolume);
+                                screens.invalidate(SETTINGS);
                             } else if (i == 2) { // Nt "BACK TO MENU"
                                 gameState = MENU;
                             }
                             break;
                         }
                     }
-                } else if (gameState == PLAYING && e.button.button == SDL_BUTTON_RIGHT) {
-                    SDL_GetMouseState(&targetX, &targetY);
-                    player.tex = (targetX > player.rect.x + player.rect.w / 2) ? playerTexRight : playerTexLeft;
+                } else if (gameState == PLAYING && e.button.button == SDL_BUTTON_RIGHT && !replaying) {
+                    targetX = mouseX;
+                    targetY = mouseY;
+                    input(ReplayEvent{0, REPLAY_TARGET, targetX, targetY, 0}, e.button.timestamp);
                 }
             } else if (e.type == SDL_KEYDOWN) {
                 if (e.key.keysym.sym == SDLK_ESCAPE) {
-                    if (gameState == PLAYING || gameState == GAME_OVER ||
+                    if (replaying) {
+                        quit = true;
+                    } else if (gameState == PLAYING || gameState == GAME_OVER ||
                         gameState == HOW_TO_PLAY || gameState == SETTINGS || gameState == HIGHSCORE) {
                         gameState = MENU;
                     }
                 } else if (e.key.keysym.sym == SDLK_RETURN) {
-                    if (gameState == GAME_OVER) {
+                    if (replaying) {
+                        sim.send(SimCommand{SIM_REPLAY_RESTART, ReplayEvent(), 0});
+                        generation++;
+                        gameState = PLAYING;
+                    } else if (gameState == GAME_OVER) {
                         gameState = PLAYING;
-                        resetGame(player, bullets, shields, survivalTime, lastWall, firstShieldUsed, startTime,
-                                  nextBulletTypeToSpawn, targetX, targetY, currentMouseX, currentMouseY, playerTexRight);
+                        input(ReplayEvent{0, REPLAY_RESTART, mode, 0, sessionSeeds.next()}, e.common.timestamp);
+                        currentMouseX = targetX = PLAYER_START_X;
+                        currentMouseY = targetY = PLAYER_START_Y;
                     } else if (gameState == PLAYING) {
-                        if (!firstShieldUsed || SDL_GetTicks() - lastWall > wallCooldown) {
-                            int playerCenterX = player.rect.x + player.rect.w / 2;
-                            int playerCenterY = player.rect.y + player.rect.h / 2;
-
-                            float dx = currentMouseX - playerCenterX;
-                            float dy = currentMouseY - playerCenterY;
-                            bool isHorizontalShield = abs(dx) < abs(dy);
-
-                            shields.push_back(Shield(playerCenterX, playerCenterY, isHorizontalShield));
-                            lastWall = SDL_GetTicks();
-                            firstShieldUsed = true;
-                        }
+                        input(ReplayEvent{0, REPLAY_SHIELD, currentMouseX, currentMouseY, 0}, e.key.timestamp);
                     }
+                } else if (replaying && (e.key.keysym.sym == SDLK_LEFT || e.key.keysym.sym == SDLK_RIGHT)) {
+                    Sint64 jump = e.key.keysym.sym == SDLK_RIGHT ? 10 * SIM_HZ : -10 * SIM_HZ;
+                    sim.send(SimCommand{SIM_SEEK, ReplayEvent(), jump});
+                    generation++;
+                    gameState = PLAYING;
+                } else if (e.key.keysym.sym == SDLK_F2) {
+                    showRenderStats = !showRenderStats;
+                } else if (e.key.keysym.sym == SDLK_F3) {
+#ifdef GAME_PROFILER
+                    profiler.overlay = !profiler.overlay;
+#endif
                 }
             }
         }
+        PROFILE_END(eventsScope);
 
-        if (gameState == PLAYING) {
-            player.moveTo(targetX, targetY);
-            Uint32 now = SDL_GetTicks();
-
-            if (firstShieldUsed) {
-                remainingCooldown = (wallCooldown - (now - lastWall)) / 1000;
-                if (remainingCooldown < 0) remainingCooldown = 0;
-            } else {
-                remainingCooldown = 0;
+        // Pick up the newest snapshot. One taken before our last restart or
+        // seek still describes the previous run and must not end this one.
+        sim.snapshots.update();
+        const SimSnapshot& view = sim.snapshots.readSlot();
+        // Hits are heard on the frame that first shows them, so sound and
+        // picture stay together however many land at once.
+        if (view.session != heardSession) {
+            heardSession = view.session;
+            heardHealth = view.health;
+        } else if (gameState == PLAYING && view.health < heardHealth) {
+            heardHealth = view.health;
+            if (!view.over) sfx.play(SFX_HIT);
+        }
+        if (gameState == PLAYING && view.session == generation && (replaying ? view.finished : view.over)) {
+            gameState = GAME_OVER;
+            if (view.over) sfx.play(SFX_EXPLOSION);
+            if (!replaying) {
+                const char* name = view.mode == MODE_BULLET_HELL ? "BulletHell" : "Player";
+                leaderboard.insert(name, view.survivalTime);
+                scoreStore.append(name, view.survivalTime);
+                highScore = leaderboard.highest();
+                screens.invalidate(HIGHSCORE);
             }
+        }
+        sim.setRunning(gameState == PLAYING);
 
-            if (now - lastSpawn > spawnDelay) {
-                spawnBullet(bullets, player.rect.x, player.rect.y, nextBulletTypeToSpawn);
-                lastSpawn = now;
+        // Bursts for the impacts not shown yet, then the particles move on by
+        // this frame's wall time. They keep going on the game over screen.
+        Uint64 particleNow = SDL_GetPerformanceCounter();
+        float frameSeconds = min(0.1f, (float)((particleNow - particleClock) / (double)perfFrequency));
+        particleClock = particleNow;
+        if (gameState == PLAYING || gameState == GAME_OVER) {
+            Uint32 impactEnd = view.impactBase + (Uint32)view.impacts.size();
+            if ((Sint32)(impactEnd - impactsShown) > 0) {
+                size_t from = min(view.impacts.size(), (size_t)(impactsShown - view.impactBase));
+                for (size_t i = from; i < view.impacts.size(); i++) particles.burst(view.impacts[i]);
+                impactsShown = impactEnd;
+                sim.impactsTaken.store(impactsShown, memory_order_release);
             }
+            particles.update(frameSeconds);
+        } else {
+            particles.clear();
+        }
 
-            for (auto& b : bullets) b.move();
+        // Interpolate from the snapshot's previous step towards its latest by
+        // how far we are into the following tick.
+        float alpha = 1.0f;
+        if (gameState == PLAYING) {
+            Uint64 now = SDL_GetPerformanceCounter();
+            alpha = now > view.stepCounter ? (float)((now - view.stepCounter) * SIM_HZ / (double)perfFrequency) : 0.0f;
+            alpha = min(alpha, 1.0f);
+        }
 
-            vector<Bullet> remaining;
-            for (auto& b : bullets) {
-                bool hitShield = false;
-                for (auto& s : shields) {
-                    if (checkCollision(b.rect, s.rect)) {
-                        hitShield = true;
-                        break;
-                    }
-                }
-                if (hitShield) continue;
-                if (checkCollision(b.rect, player.rect)) {
-                    gameState = GAME_OVER;
-                    if (survivalTime > highScore) {
-                        highScore = survivalTime;
-                        updateHighScores(survivalTime);
-                    }
-                } else {
-                    remaining.push_back(b);
-                }
-            }
-            bullets = remaining;
-            shields.erase(remove_if(shields.begin(), shields.end(), [](Shield& s) { return s.isExpired(); }), shields.end());
-            survivalTime = (SDL_GetTicks() - startTime) / 1000;
+        // An idle screen that nothing has touched is already on the window.
+        // The profiler overlay keeps updating, so it keeps the loop drawing.
+        bool overlay = false;
+#ifdef GAME_PROFILER
+        overlay = profiler.overlay;
+#endif
+        bool idle = gameState != PLAYING;
+        if (idle && !redraw && drawnState == gameState && !overlay) {
+            lastFrameAllocs = allocStats.since(frameAllocStart);
+#ifdef GAME_PROFILER
+            profiler.endFrame();
+#endif
+            continue;
         }
+        // Particles still in flight need the next frame too.
+        redraw = particles.count > 0;
+        drawnState = gameState;
+        Uint32 latched = 0;
 
+        Uint64 renderStart = SDL_GetPerformanceCounter();
+        PROFILE_BEGIN(renderScope, PHASE_RENDER);
         SDL_RenderClear(renderer);
+        textCache.beginFrame();
+        lastFrameStats = renderStats;
+        renderStats.beginFrame();
 
         switch (gameState) {
             case MENU:
-                renderMenu(renderer, menuTex, menuButtons, font);
+                screens.present(renderer, MENU, [&] { renderMenu(renderer, menuTex, menuButtons, font); });
                 break;
             case HOW_TO_PLAY:
-                renderHowToPlay(renderer, menuTex, backButtons, font, fontLarge, fontMedium);
+                screens.present(renderer, HOW_TO_PLAY, [&] { renderHowToPlay(renderer, menuTex, backButtons, font, fontLarge, fontMedium); });
                 break;
             case SETTINGS:
-                renderSettings(renderer, menuTex, settingsButtons, font, fontLarge, fontMedium, musicVolume, soundVolume);
+                screens.present(renderer, SETTINGS, [&] {
+                    renderSettings(renderer, menuTex, settingsButtons, font, fontLarge, fontMedium, musicVolume, soundVolume);
+                });
                 break;
             case HIGHSCORE:
-                renderHighscore(renderer, menuTex, backButtons, font, fontLarge, fontMedium);
+                screens.present(renderer, HIGHSCORE, [&] { renderHighscore(renderer, menuTex, backButtons, font, fontLarge, fontMedium, leaderboard); });
                 break;
             case PLAYING:
             case GAME_OVER:
-                renderGame(renderer, bgTex, wallTex, shields, bullets, bulletTextures, player, font, fontLarge, fontMedium,
-                           survivalTime, highScore, remainingCooldown, gameState);
+                renderGame(renderer, bgTex, spriteBatch, view, font, fontLarge, fontMedium,
+                           highScore, gameState, alpha, showRenderStats);
+                if (lateLatch && gameState == PLAYING && !replaying) {
+                    SDL_PumpEvents();
+                    SDL_Event late;
+                    while (SDL_PeepEvents(&late, 1, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEBUTTONDOWN) > 0) {
+                        if (late.type == SDL_MOUSEMOTION) {
+                            currentMouseX = late.motion.x;
+                            currentMouseY = late.motion.y;
+                        } else if (late.button.button == SDL_BUTTON_RIGHT) {
+                            targetX = late.button.x;
+                            targetY = late.button.y;
+                            latched = input(ReplayEvent{0, REPLAY_TARGET, targetX, targetY, 0}, late.button.timestamp);
+                        }
+                    }
+                    renderTargetMarker(renderer, targetX, targetY);
+                }
+                break;
+            default:
                 break;
         }
+#ifdef GAME_PROFILER
+        if (profiler.overlay) renderProfilerOverlay(renderer, font);
+#endif
+        PROFILE_END(renderScope);
 
+        // With vsync, present mostly waits for the display, so it is left
+        // out of the time the resolution controller sees.
+        Uint64 renderEnd = SDL_GetPerformanceCounter();
+        PROFILE_BEGIN(presentScope, PHASE_PRESENT);
         SDL_RenderPresent(renderer);
-        SDL_Delay(16);
+        PROFILE_END(presentScope);
+        if (!vsync) renderEnd = SDL_GetPerformanceCounter();
+        if (gameState == PLAYING || gameState == GAME_OVER) {
+            resolution.frameTime((float)((renderEnd - renderStart) * 1000.0 / perfFrequency));
+        }
+        inputLatency.presented(view.inputs, latched, SDL_GetTicks());
+        lastFrameAllocs = allocStats.since(frameAllocStart);
+#ifdef GAME_PROFILER
+        profiler.endFrame();
+#endif
+    }
+#ifdef GAME_PROFILER
+    profiler.close();
+#endif
+
+    sim.stop();
+    spectators.close();
+    jobs.stop();
+    scoreStore.close();
+    if (inputLatency.sampleCount) {
+        SDL_Log("input latency over %d inputs: p50 %.0f ms, p95 %.0f ms, p99 %.0f ms, max %.0f ms", inputLatency.sampleCount,
+                inputLatency.percentile(0.5), inputLatency.percentile(0.95), inputLatency.percentile(0.99),
+                inputLatency.percentile(1.0));
     }
 
     Mix_FreeMusic(bgMusic);
-    Mix_FreeChunk(explosionSound);
-    if (buttonClickSound) Mix_FreeChunk(buttonClickSound);
+    sfx.destroy();
 
     SDL_DestroyTexture(bgTex);
     SDL_DestroyTexture(menuTex);
-    SDL_DestroyTexture(wallTex);
-    SDL_DestroyTexture(playerTexLeft);
-    SDL_DestroyTexture(playerTexRight);
-
-    for (int i = 0; i < 6; ++i) {
-        SDL_DestroyTexture(bulletTextures[i]);
-    }
+    screens.destroy();
+    resolution.destroy();
+    sprites.destroy();
 
+    textCache.clear();
     TTF_CloseFont(font);
     TTF_CloseFont(fontLarge);
     TTF_CloseFont(fontMedium);
 
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
+    assets.close();
 
     Mix_Quit();
     TTF_Quit();